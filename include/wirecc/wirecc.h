@@ -15,6 +15,20 @@
 #include <cassert>
 #include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <memory>
+#include <iterator>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <random>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #if WIRECC_DEBUG == 0
 #define WIRECC_ASSERT(cond) do{} while(0)
@@ -61,6 +75,9 @@ namespace WireCC {
         };
         typedef std::set<ResourceId> ResourceSet;
         typedef Iterator<ResourceSet> ResourceIterator;
+        typedef std::vector<ResourceId> FlatResourceSet;
+        typedef Iterator<FlatResourceSet> FlatResourceIterator;
+        typedef std::shared_ptr<const FlatResourceSet> SharedResourceSet;
 
         /**
          * @brief Deallocates values in a container range.
@@ -99,6 +116,522 @@ namespace WireCC {
                 return ResourceIterator();
         }
 
+        /**
+         * @brief Sorts and deduplicates ResourceIds.
+         * @param ids The ids, sorted in increasing order with duplicates removed
+         * @param threads Number of threads to sort with
+         * @details LSD radix sort over four 8-bit digits, with the sign bit flipped
+         *          so that negative ids sort first. Passes where all ids share the
+         *          same digit are skipped. With several threads each one builds the
+         *          histogram of its own chunk and scatters it to disjoint offsets.
+         */
+        inline void sortResourceIds(FlatResourceSet& ids, unsigned int threads=1)
+        {
+                size_t n = ids.size();
+                if (n < 256){
+                        std::sort(ids.begin(), ids.end());
+                        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+                        return;
+                }
+                threads = (unsigned int) std::max<size_t>(1, std::min<size_t>(threads, n / 65536));
+                FlatResourceSet tmp(n);
+                ResourceId * src = ids.data();
+                ResourceId * dst = tmp.data();
+                std::vector<size_t> counts(threads * 256);
+                std::vector<std::thread> workers;
+                auto parallel = [&](const std::function<void(unsigned int, size_t, size_t)>& fn) {
+                        for (unsigned int t=1; t < threads; ++t){
+                                workers.push_back(std::thread(fn, t, n * t / threads, n * (t + 1) / threads));
+                        }
+                        fn(0, 0, n / threads);
+                        for (size_t t=0; t < workers.size(); ++t){
+                                workers[t].join();
+                        }
+                        workers.clear();
+                };
+                for (unsigned int shift=0; shift < 32; shift += 8){
+                        std::fill(counts.begin(), counts.end(), 0);
+                        parallel([&](unsigned int t, size_t from, size_t to) {
+                                size_t * count = &counts[t * 256];
+                                for (size_t i=from; i < to; ++i){
+                                        ++count[(((uint32_t) src[i] ^ 0x80000000u) >> shift) & 0xff];
+                                }
+                        });
+                        size_t offset = 0;
+                        bool trivial = false;
+                        for (unsigned int d=0; d < 256; ++d){
+                                size_t total = 0;
+                                for (unsigned int t=0; t < threads; ++t){
+                                        size_t c = counts[t * 256 + d];
+                                        counts[t * 256 + d] = offset + total;
+                                        total += c;
+                                }
+                                trivial = trivial || (total == n);
+                                offset += total;
+                        }
+                        if (trivial){
+                                continue;
+                        }
+                        parallel([&](unsigned int t, size_t from, size_t to) {
+                                size_t * next = &counts[t * 256];
+                                for (size_t i=from; i < to; ++i){
+                                        dst[next[(((uint32_t) src[i] ^ 0x80000000u) >> shift) & 0xff]++] = src[i];
+                                }
+                        });
+                        std::swap(src, dst);
+                }
+                if (src != ids.data()){
+                        ids.swap(tmp);
+                }
+                ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        }
+
+        /**
+         * @brief Builds a ResourceSet from unsorted ids in one linear pass.
+         * @param ids The ids, sorted and deduplicated in place
+         * @param val Reference to the ResourceSet to populate, its contents are replaced
+         * @param threads Number of threads to sort with
+         */
+        inline void buildResourceSet(FlatResourceSet& ids, ResourceSet& val, unsigned int threads=1)
+        {
+                sortResourceIds(ids, threads);
+                val.clear();
+                for (FlatResourceIterator itr = FlatResourceIterator(ids); itr.current != itr.end; ++itr.current){
+                        val.insert(val.end(), *itr.current);
+                }
+        }
+
+        /**
+         * @brief Defers destruction of shared objects until no reader can see them.
+         * @details Epoch-based reclamation: readers announce the global epoch in a
+         *          slot of their own while they access shared data, without taking
+         *          locks. Objects retired by writers are tagged with the epoch they
+         *          were retired in and destroyed by collect() once every active
+         *          reader has entered a later epoch. Reader slots are aligned to a
+         *          cache line so that readers don't contend with each other.
+         */
+        class EpochManager
+        {
+        public:
+                /**
+                 * @brief Holds a reader inside an epoch for its lifetime.
+                 */
+                class Guard
+                {
+                public:
+                        /**
+                         * @brief Enters an epoch.
+                         * @param epochs The epoch manager
+                         * @param slot Slot obtained with registerReader()
+                         */
+                        Guard(EpochManager& epochs, unsigned int slot) : epochs(epochs), slot(slot) {epochs.enter(slot);}
+                        ~Guard() {epochs.exit(slot);}
+
+                private:
+                        EpochManager& epochs;
+                        unsigned int slot;
+                        WIRECC_DISABLE_COPY_AND_ASSIGN(Guard);
+                };
+
+                /**
+                 * @brief Constructs an epoch manager.
+                 * @param maxReaders Maximum number of registered readers
+                 */
+                explicit EpochManager(unsigned int maxReaders=64)
+                        : storage(new uint8_t[(maxReaders + 1) * sizeof(Slot)]), maxReaders(maxReaders), epoch(1)
+                {
+                        // Aligned by hand, as new only honors alignas(64) from C++17
+                        void * first = storage.get();
+                        size_t space = (maxReaders + 1) * sizeof(Slot);
+                        slots = (Slot *) std::align(alignof(Slot), maxReaders * sizeof(Slot), first, space);
+                        for (unsigned int i=0; i < maxReaders; ++i){
+                                new (slots + i) Slot();
+                        }
+                }
+
+                /**
+                 * @brief Destroys all retired objects.
+                 * @details No reader may be inside an epoch.
+                 */
+                ~EpochManager()
+                {
+                        for (size_t i=0; i < retired.size(); ++i){
+                                retired[i].second();
+                        }
+                }
+
+                /**
+                 * @brief Reserves a reader slot.
+                 * @param slot Receives the slot, used by one thread at a time
+                 * @return true if a slot was free, false otherwise
+                 */
+                bool registerReader(unsigned int& slot)
+                {
+                        for (unsigned int i=0; i < maxReaders; ++i){
+                                bool expected = false;
+                                if (slots[i].used.compare_exchange_strong(expected, true)){
+                                        slot = i;
+                                        return true;
+                                }
+                        }
+                        return false;
+                }
+
+                /**
+                 * @brief Releases a reader slot.
+                 * @param slot Slot obtained with registerReader(), outside of any epoch
+                 */
+                void unregisterReader(unsigned int slot)
+                {
+                        WIRECC_ASSERT(slot < maxReaders && slots[slot].epoch.load() == IDLE);
+                        slots[slot].used.store(false);
+                }
+
+                /**
+                 * @brief Enters the current epoch. Prefer Guard.
+                 * @param slot Slot obtained with registerReader()
+                 * @details Shared pointers loaded after entering stay valid until exit().
+                 */
+                void enter(unsigned int slot)
+                {
+                        WIRECC_ASSERT(slot < maxReaders);
+                        slots[slot].epoch.store(epoch.load());
+                }
+
+                /**
+                 * @brief Exits the epoch entered with enter().
+                 * @param slot Slot obtained with registerReader()
+                 */
+                void exit(unsigned int slot)
+                {
+                        WIRECC_ASSERT(slot < maxReaders);
+                        slots[slot].epoch.store(IDLE, std::memory_order_release);
+                }
+
+                /**
+                 * @brief Defers the destruction of an object that readers may still see.
+                 * @param deleter Callable destroying the object, called by collect()
+                 * @details The object must already be unreachable for new readers.
+                 */
+                void retire(const std::function<void()>& deleter)
+                {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        retired.push_back(std::make_pair(epoch.fetch_add(1), deleter));
+                }
+
+                /**
+                 * @brief Destroys the retired objects no reader can see anymore.
+                 * @return Number of objects destroyed
+                 */
+                size_t collect()
+                {
+                        uint64_t oldest = IDLE;
+                        for (unsigned int i=0; i < maxReaders; ++i){
+                                oldest = std::min(oldest, slots[i].epoch.load());
+                        }
+                        std::vector<std::function<void()> > ready;
+                        {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                size_t kept = 0;
+                                for (size_t i=0; i < retired.size(); ++i){
+                                        if (retired[i].first < oldest){
+                                                ready.push_back(retired[i].second);
+                                        } else {
+                                                retired[kept++] = retired[i];
+                                        }
+                                }
+                                retired.resize(kept);
+                        }
+                        for (size_t i=0; i < ready.size(); ++i){
+                                ready[i]();
+                        }
+                        return ready.size();
+                }
+
+                /**
+                 * @brief Gets the number of objects waiting to be destroyed.
+                 * @return Number of retired objects
+                 */
+                size_t pending()
+                {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        return retired.size();
+                }
+
+        protected:
+                static const uint64_t IDLE = ~(uint64_t) 0;
+
+                struct alignas(64) Slot
+                {
+                        Slot() : epoch(IDLE), used(false) {}
+                        std::atomic<uint64_t> epoch;
+                        std::atomic<bool> used;
+                };
+
+                std::unique_ptr<uint8_t[]> storage;
+                Slot * slots;
+                unsigned int maxReaders;
+                std::atomic<uint64_t> epoch;
+                std::mutex mutex;
+                std::vector<std::pair<uint64_t, std::function<void()> > > retired;
+
+        private:
+                WIRECC_DISABLE_COPY_AND_ASSIGN(EpochManager);
+        };
+
+        /**
+         * @brief Deletes a map of pointers along with its values.
+         * @tparam T Map type with pointer values
+         * @param map The map to delete
+         */
+        template<typename T>
+        void deleteWithValues(T * map)
+        {
+                deallocValues(map->begin(), map->end());
+                delete map;
+        }
+
+        /**
+         * @brief Publishes versions of an object to lock-free readers.
+         * @tparam T Type of the published object, typically a map of ResourceSets
+         * @details Writers replace the current version with publish(); the previous
+         *          version is retired to the EpochManager and destroyed once no
+         *          reader can see it. Readers call get() inside an EpochManager::Guard
+         *          and can keep iterators (e.g. from getIteratorFromMap()) over the
+         *          version they got until the guard is released.
+         */
+        template<typename T>
+        class Published
+        {
+        public:
+                typedef void (*Deleter)(T *);
+
+                /**
+                 * @brief Constructs a publisher.
+                 * @param epochs Epoch manager readers enter, must outlive the publisher
+                 * @param initial First version, owned by the publisher (may be NULL)
+                 * @param deleter Function destroying versions
+                 */
+                Published(EpochManager& epochs, T * initial=NULL, Deleter deleter=deleteObject)
+                        : epochs(epochs), current(initial), deleter(deleter) {}
+
+                /**
+                 * @brief Destroys the current version.
+                 * @details No reader may be inside an epoch.
+                 */
+                ~Published()
+                {
+                        T * last = current.load();
+                        if (last != NULL){
+                                deleter(last);
+                        }
+                }
+
+                /**
+                 * @brief Gets the current version.
+                 * @return The version, valid until the caller's epoch guard is released
+                 */
+                const T * get() const {return current.load();}
+
+                /**
+                 * @brief Replaces the current version.
+                 * @param next New version, owned by the publisher
+                 * @details Writers must be serialized by the caller. Retired versions are
+                 *          destroyed by a later EpochManager::collect().
+                 */
+                void publish(T * next)
+                {
+                        T * old = current.exchange(next);
+                        if (old != NULL){
+                                Deleter del = deleter;
+                                epochs.retire([old, del]() {del(old);});
+                        }
+                }
+
+        protected:
+                static void deleteObject(T * val) {delete val;}
+
+                EpochManager& epochs;
+                std::atomic<T *> current;
+                Deleter deleter;
+
+        private:
+                WIRECC_DISABLE_COPY_AND_ASSIGN(Published);
+        };
+
+        /**
+         * @brief A concurrent map from ResourceId to values, split in locked shards.
+         * @tparam V Value type, ResourceSet by default
+         * @details Each id hashes to one of a power-of-two number of shards, each
+         *          holding its own mutex and hash map, so threads updating different
+         *          ids rarely wait on each other. Shards are padded so that adjacent
+         *          locks don't share a cache line. Values are only accessed under
+         *          their shard's lock, through the callables given to visit() and
+         *          update().
+         */
+        template<typename V = ResourceSet>
+        class ShardedMap
+        {
+        public:
+                typedef std::unordered_map<ResourceId, V> Map;
+
+                /**
+                 * @brief Constructs an empty map.
+                 * @param shardCount Number of shards, rounded up to a power of two
+                 */
+                explicit ShardedMap(unsigned int shardCount=64) : mask(1)
+                {
+                        while (mask < shardCount){
+                                mask <<= 1;
+                        }
+                        shards.reset(new Shard[mask]);
+                        --mask;
+                }
+
+                /**
+                 * @brief Reads the value of an id under its shard lock.
+                 * @param rid The id to look up
+                 * @param fn Callable taking a const V&, e.g. to walk a ResourceIterator over it
+                 * @return true if the id was found and fn called, false otherwise
+                 */
+                template<typename F>
+                bool visit(ResourceId rid, F fn) const
+                {
+                        Shard& shard = shardOf(rid);
+                        std::lock_guard<std::mutex> lock(shard.mutex);
+                        typename Map::const_iterator itr = shard.map.find(rid);
+                        if (itr == shard.map.end()){
+                                return false;
+                        }
+                        fn(itr->second);
+                        return true;
+                }
+
+                /**
+                 * @brief Modifies the value of an id under its shard lock.
+                 * @param rid The id to update, added with a default value if missing
+                 * @param fn Callable taking a V&
+                 */
+                template<typename F>
+                void update(ResourceId rid, F fn)
+                {
+                        Shard& shard = shardOf(rid);
+                        std::lock_guard<std::mutex> lock(shard.mutex);
+                        fn(shard.map[rid]);
+                }
+
+                /**
+                 * @brief Copies the value of an id.
+                 * @param rid The id to look up
+                 * @param val Receives a copy of the value
+                 * @return true if the id was found, false otherwise
+                 */
+                bool get(ResourceId rid, V& val) const
+                {
+                        return visit(rid, [&val](const V& found) {val = found;});
+                }
+
+                /**
+                 * @brief Adds an id if missing.
+                 * @param rid The id to add
+                 * @param val The value to add
+                 * @return true if the id was added, false if already present
+                 */
+                bool insert(ResourceId rid, const V& val)
+                {
+                        Shard& shard = shardOf(rid);
+                        std::lock_guard<std::mutex> lock(shard.mutex);
+                        return shard.map.insert(std::make_pair(rid, val)).second;
+                }
+
+                /**
+                 * @brief Sets the value of an id.
+                 * @param rid The id to set
+                 * @param val The new value
+                 */
+                void assign(ResourceId rid, const V& val)
+                {
+                        Shard& shard = shardOf(rid);
+                        std::lock_guard<std::mutex> lock(shard.mutex);
+                        shard.map[rid] = val;
+                }
+
+                /**
+                 * @brief Removes an id.
+                 * @param rid The id to remove
+                 * @return true if the id was removed, false if not present
+                 */
+                bool erase(ResourceId rid)
+                {
+                        Shard& shard = shardOf(rid);
+                        std::lock_guard<std::mutex> lock(shard.mutex);
+                        return (shard.map.erase(rid) > 0);
+                }
+
+                /**
+                 * @brief Checks whether an id is in the map.
+                 * @param rid The id to look up
+                 * @return true if present, false otherwise
+                 */
+                bool contains(ResourceId rid) const
+                {
+                        Shard& shard = shardOf(rid);
+                        std::lock_guard<std::mutex> lock(shard.mutex);
+                        return (shard.map.count(rid) > 0);
+                }
+
+                /**
+                 * @brief Gets the number of ids in the map.
+                 * @return Number of ids, locking one shard at a time
+                 */
+                size_t size() const
+                {
+                        size_t ret = 0;
+                        for (unsigned int i=0; i <= mask; ++i){
+                                std::lock_guard<std::mutex> lock(shards[i].mutex);
+                                ret += shards[i].map.size();
+                        }
+                        return ret;
+                }
+
+                /**
+                 * @brief Removes all ids, locking one shard at a time.
+                 */
+                void clear()
+                {
+                        for (unsigned int i=0; i <= mask; ++i){
+                                std::lock_guard<std::mutex> lock(shards[i].mutex);
+                                shards[i].map.clear();
+                        }
+                }
+
+                /**
+                 * @brief Gets the number of shards.
+                 * @return Number of shards, a power of two
+                 */
+                unsigned int shardCount() const {return mask + 1;}
+
+        protected:
+                struct Shard
+                {
+                        std::mutex mutex;
+                        Map map;
+                        char pad[64];
+                };
+
+                Shard& shardOf(ResourceId rid) const
+                {
+                        uint32_t h = (uint32_t) rid * 0x9E3779B1u;
+                        return shards[(h ^ (h >> 16)) & mask];
+                }
+
+                std::unique_ptr<Shard[]> shards;
+                unsigned int mask;
+
+        private:
+                WIRECC_DISABLE_COPY_AND_ASSIGN(ShardedMap);
+        };
+
         /**
          * @brief Generates combinations of elements from a container.
          * @tparam T Container type
@@ -272,329 +805,5373 @@ namespace WireCC {
         }
 
         /**
-         * @brief A byte buffer for reading and writing binary data.
-         * @details Provides methods for serializing and deserializing various data types
-         *          in big-endian format. Must call load() or clear() before use.
-         * @warning Mixing byte reads and writes is not supported.
-         * @warning Assumes two's complement representation for signed numbers.
+         * @brief Gets the encoded size of a varint.
+         * @param val The value to measure
+         * @return Number of bytes varintEncode() writes for the value (1 to 10)
          */
-        class ByteBuffer
+        inline unsigned int varintSize(uint64_t val)
         {
-        public:
-                /**
-                 * @brief Default constructor that clears the buffer.
-                 */
-                ByteBuffer() {clear();}
+                unsigned int n = 1;
+                while (val >= 0x80){
+                        val >>= 7;
+                        ++n;
+                }
+                return n;
+        }
 
-                /**
-                 * @brief Reads a ByteBuffer from the current position.
-                 * @param buffer The buffer to store the read data
-                 */
-                void readBuffer(ByteBuffer& buffer)
-                {
-                        unsigned int size;
-                        readUint(size);
-                        buffer.load(&buf[pos], size);
-                        pos += size;
+        /**
+         * @brief Encodes an unsigned integer as a LEB128 varint.
+         * @param val The value to encode
+         * @param buf Buffer to store the encoded bytes (must be at least varintSize(val) bytes)
+         * @return Number of bytes written
+         * @details Seven bits per byte, least significant group first, with the high
+         *          bit set on every byte but the last.
+         */
+        inline unsigned int varintEncode(uint64_t val, uint8_t * buf)
+        {
+                unsigned int n = 0;
+                while (val >= 0x80){
+                        buf[n++] = (uint8_t) (val | 0x80);
+                        val >>= 7;
                 }
+                buf[n++] = (uint8_t) val;
+                return n;
+        }
 
-                /**
-                 * @brief Writes a ByteBuffer to the current position.
-                 * @param b The buffer to write
-                 */
-                void writeBuffer(const ByteBuffer& b)
-                {
-                        writeUint(b.size());
-                        buf.insert(buf.end(), b.data(), b.data()+b.size());
-                        pos += b.size();
+        /**
+         * @brief Decodes a LEB128 varint.
+         * @param buf Buffer containing the encoded bytes
+         * @param val Reference to store the decoded value
+         * @return Number of bytes consumed
+         */
+        inline unsigned int varintDecode(const uint8_t * buf, uint64_t& val)
+        {
+                if (buf[0] < 0x80){
+                        val = buf[0];
+                        return 1;
                 }
+                val = 0;
+                unsigned int n = 0;
+                unsigned int shift = 0;
+                do {
+                        val |= (uint64_t) (buf[n] & 0x7f) << shift;
+                        shift += 7;
+                } while (buf[n++] >= 0x80 && shift < 64);
+                return n;
+        }
 
-                /**
-                 * @brief Reads a 64-bit unsigned integer from the buffer.
-                 * @param val Reference to store the read value
-                 */
-                void readU64(uint64_t& val)
-                {
-                        val = be64decode(&buf[pos]);
-                        pos += sizeof(uint64_t);
+        /**
+         * @brief Gets the encoded size of a varint from its first bytes.
+         * @param buf Buffer containing the encoded bytes
+         * @return Number of bytes the varint occupies
+         */
+        inline unsigned int varintLength(const uint8_t * buf)
+        {
+                unsigned int n = 0;
+                while (buf[n] >= 0x80 && n < 9){
+                        ++n;
                 }
+                return n + 1;
+        }
 
-                /**
-                 * @brief Writes a 64-bit unsigned integer to the buffer.
-                 * @param val The value to write
-                 */
-                void writeU64(uint64_t val)
+        /**
+         * @brief Gets the length of the UTF-8 sequence starting at a byte.
+         * @param s Pointer to the first byte of the sequence
+         * @param left Number of bytes available from s
+         * @return Length of the sequence (1 to 4), or 0 if it is not valid UTF-8
+         * @details Rejects overlong forms, surrogates and code points above U+10FFFF.
+         */
+        inline unsigned int utf8SequenceLength(const uint8_t * s, unsigned int left)
+        {
+                uint8_t c = s[0];
+                if (c < 0x80){
+                        return 1;
+                }
+                if (c < 0xC2 || c > 0xF4){
+                        return 0;
+                }
+                unsigned int n = (c < 0xE0 ? 2 : (c < 0xF0 ? 3 : 4));
+                if (left < n){
+                        return 0;
+                }
+                // Second byte range depends on the lead byte
+                uint8_t lo = 0x80, hi = 0xBF;
+                if (c == 0xE0){
+                        lo = 0xA0;
+                } else if (c == 0xED){
+                        hi = 0x9F;
+                } else if (c == 0xF0){
+                        lo = 0x90;
+                } else if (c == 0xF4){
+                        hi = 0x8F;
+                }
+                if (s[1] < lo || s[1] > hi){
+                        return 0;
+                }
+                for (unsigned int i=2; i < n; ++i){
+                        if ((s[i] & 0xC0) != 0x80){
+                                return 0;
+                        }
+                }
+                return n;
+        }
+
+        /**
+         * @brief Validates UTF-8 bytes, optionally copying them.
+         * @param src Pointer to the bytes to check
+         * @param size Number of bytes to check
+         * @param dst Destination buffer (at least size bytes), or NULL to only validate
+         * @return true if the bytes are valid UTF-8, false otherwise
+         * @details Bytes are loaded 16 (SSE2) or 32 (AVX2) at a time. A block with a
+         *          non-ASCII byte skips its ASCII prefix and is then checked by scalar
+         *          code up to its end, so each block is loaded only once.
+         */
+        inline bool utf8Scan(const uint8_t * src, unsigned int size, uint8_t * dst)
+        {
+                unsigned int i = 0, scalarEnd = 0;
+                while (i < size){
+                        if (i >= scalarEnd){
+                                unsigned int block = 0, ascii = 0;
+#if defined(__AVX2__)
+                                if (i + 32 <= size){
+                                        __m256i v = _mm256_loadu_si256((const __m256i *) (src + i));
+                                        if (dst != NULL){
+                                                _mm256_storeu_si256((__m256i *) (dst + i), v);
+                                        }
+                                        uint32_t mask = _mm256_movemask_epi8(v);
+                                        block = 32;
+                                        ascii = (mask == 0 ? 32 : __builtin_ctz(mask));
+                                }
+#endif
+#if defined(__SSE2__)
+                                if (block == 0 && i + 16 <= size){
+                                        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+                                        if (dst != NULL){
+                                                _mm_storeu_si128((__m128i *) (dst + i), v);
+                                        }
+                                        uint32_t mask = _mm_movemask_epi8(v);
+                                        block = 16;
+                                        ascii = (mask == 0 ? 16 : __builtin_ctz(mask));
+                                }
+#endif
+                                if (block > 0){
+                                        scalarEnd = i + block;
+                                        i += ascii;
+                                        if (ascii == block){
+                                                continue;
+                                        }
+                                }
+                        }
+                        unsigned int n = utf8SequenceLength(src + i, size - i);
+                        if (n == 0){
+                                return false;
+                        }
+                        if (dst != NULL){
+                                memcpy(dst + i, src + i, n);
+                        }
+                        i += n;
+                }
+                return true;
+        }
+
+        /**
+         * @brief Copies bytes while validating that they are UTF-8.
+         * @param src Pointer to the bytes to copy
+         * @param size Number of bytes to copy
+         * @param dst Destination buffer (must be at least size bytes)
+         * @return true if the bytes are valid UTF-8, false otherwise
+         * @details dst content is unspecified on failure.
+         */
+        inline bool utf8Copy(const uint8_t * src, unsigned int size, uint8_t * dst)
+        {
+                return utf8Scan(src, size, dst);
+        }
+
+        /**
+         * @brief Checks if bytes are valid UTF-8.
+         * @param data Pointer to the bytes to check
+         * @param size Number of bytes to check
+         * @return true if the bytes are valid UTF-8, false otherwise
+         */
+        inline bool utf8Validate(const uint8_t * data, unsigned int size)
+        {
+                return utf8Scan(data, size, NULL);
+        }
+
+        /**
+         * @brief Bit-packs 32-bit values in four interleaved lanes.
+         * @param in Values to pack, 4 * perLane of them, each below 2^width
+         * @param perLane Number of values per lane
+         * @param width Bits per value (0 to 32)
+         * @param out Buffer for the packed words (must be at least bitPackedSize(perLane, width) bytes)
+         * @return Number of bytes written
+         * @details Value i goes to lane i % 4, and each lane is a little-endian bit
+         *          stream of 32-bit words, with word j of every lane stored together.
+         *          This is the SIMD-BP128 layout, so four values are packed at once
+         *          with SSE2 when available.
+         */
+        inline unsigned int bitPackLanes(const uint32_t * in, unsigned int perLane, unsigned int width, uint8_t * out)
+        {
+                unsigned int words = (perLane * width + 31) / 32;
+                if (width == 0){
+                        return 0;
+                }
+#if defined(__SSE2__)
+                __m128i acc = _mm_setzero_si128();
+                unsigned int bits = 0, w = 0;
+                for (unsigned int j=0; j < perLane; ++j){
+                        __m128i v = _mm_loadu_si128((const __m128i *) (in + 4 * j));
+                        acc = _mm_or_si128(acc, _mm_sll_epi32(v, _mm_cvtsi32_si128(bits)));
+                        bits += width;
+                        if (bits >= 32){
+                                _mm_storeu_si128((__m128i *) (out + 16 * w++), acc);
+                                bits -= 32;
+                                acc = (bits > 0 ? _mm_srl_epi32(v, _mm_cvtsi32_si128(width - bits)) : _mm_setzero_si128());
+                        }
+                }
+                if (bits > 0){
+                        _mm_storeu_si128((__m128i *) (out + 16 * w), acc);
+                }
+#else
+                for (unsigned int lane=0; lane < 4; ++lane){
+                        uint64_t acc = 0;
+                        unsigned int bits = 0, w = 0;
+                        for (unsigned int j=0; j <= perLane; ++j){
+                                if (j < perLane){
+                                        acc |= (uint64_t) in[4 * j + lane] << bits;
+                                        bits += width;
+                                }
+                                if (bits >= 32 || (j == perLane && bits > 0)){
+                                        uint8_t * word = out + 16 * w++ + 4 * lane;
+                                        word[0] = (acc & 0xff);
+                                        word[1] = ((acc >> 8) & 0xff);
+                                        word[2] = ((acc >> 16) & 0xff);
+                                        word[3] = ((acc >> 24) & 0xff);
+                                        acc >>= 32;
+                                        bits = (bits >= 32 ? bits - 32 : 0);
+                                }
+                        }
+                }
+#endif
+                return 16 * words;
+        }
+
+        /**
+         * @brief Unpacks values written by bitPackLanes().
+         * @param in The packed words
+         * @param perLane Number of values per lane
+         * @param width Bits per value (0 to 32)
+         * @param out Buffer for the values (must hold 4 * perLane values)
+         * @return Number of bytes read
+         */
+        inline unsigned int bitUnpackLanes(const uint8_t * in, unsigned int perLane, unsigned int width, uint32_t * out)
+        {
+                unsigned int words = (perLane * width + 31) / 32;
+                if (width == 0){
+                        std::fill(out, out + 4 * perLane, 0);
+                        return 0;
+                }
+#if defined(__SSE2__)
+                const __m128i mask = _mm_set1_epi32(width == 32 ? 0xffffffff : ((uint32_t) 1 << width) - 1);
+                __m128i cur = _mm_loadu_si128((const __m128i *) in);
+                unsigned int bits = 0, w = 0;
+                for (unsigned int j=0; j < perLane; ++j){
+                        __m128i v = _mm_srl_epi32(cur, _mm_cvtsi32_si128(bits));
+                        bits += width;
+                        if (bits >= 32){
+                                bits -= 32;
+                                if (++w < words){
+                                        cur = _mm_loadu_si128((const __m128i *) (in + 16 * w));
+                                        if (bits > 0){
+                                                v = _mm_or_si128(v, _mm_sll_epi32(cur, _mm_cvtsi32_si128(width - bits)));
+                                        }
+                                }
+                        }
+                        _mm_storeu_si128((__m128i *) (out + 4 * j), _mm_and_si128(v, mask));
+                }
+#else
+                uint64_t mask = ((uint64_t) 1 << width) - 1;
+                for (unsigned int lane=0; lane < 4; ++lane){
+                        uint64_t acc = 0;
+                        unsigned int bits = 0, w = 0;
+                        for (unsigned int j=0; j < perLane; ++j){
+                                if (bits < width){
+                                        const uint8_t * word = in + 16 * w++ + 4 * lane;
+                                        acc |= (uint64_t) (word[0] | (word[1] << 8) | (word[2] << 16) |
+                                                           ((uint32_t) word[3] << 24)) << bits;
+                                        bits += 32;
+                                }
+                                out[4 * j + lane] = (uint32_t) (acc & mask);
+                                acc >>= width;
+                                bits -= width;
+                        }
+                }
+#endif
+                return 16 * words;
+        }
+
+        /**
+         * @brief Converts a float to IEEE 754 half precision.
+         * @param val The value to convert
+         * @return Half precision bits, rounded to nearest even
+         */
+        inline uint16_t floatToHalf(float val)
+        {
+                uint32_t x;
+                memcpy(&x, &val, sizeof(x));
+                uint16_t sign = (x >> 16) & 0x8000;
+                uint32_t mant = x & 0x7fffff;
+                int exp = (int) ((x >> 23) & 0xff) - 127 + 15;
+                if (((x >> 23) & 0xff) == 0xff){
+                        return sign | 0x7c00 | (mant != 0 ? 0x200 : 0);
+                }
+                if (exp >= 31){
+                        return sign | 0x7c00;
+                }
+                if (exp <= 0){
+                        // Subnormal half, or zero when too small
+                        if (exp < -10){
+                                return sign;
+                        }
+                        mant |= 0x800000;
+                        unsigned int shift = 14 - exp;
+                        uint32_t half = mant >> shift;
+                        uint32_t rem = mant & ((1u << shift) - 1);
+                        uint32_t halfway = 1u << (shift - 1);
+                        if (rem > halfway || (rem == halfway && (half & 1))){
+                                ++half;
+                        }
+                        return sign | half;
+                }
+                uint32_t half = ((uint32_t) exp << 10) | (mant >> 13);
+                uint32_t rem = mant & 0x1fff;
+                if (rem > 0x1000 || (rem == 0x1000 && (half & 1))){
+                        ++half;
+                }
+                return sign | half;
+        }
+
+        /**
+         * @brief Converts IEEE 754 half precision to a float.
+         * @param val Half precision bits
+         * @return The value, exactly
+         */
+        inline float halfToFloat(uint16_t val)
+        {
+                uint32_t sign = (uint32_t) (val & 0x8000) << 16;
+                uint32_t exp = (val >> 10) & 0x1f;
+                uint32_t mant = val & 0x3ff;
+                uint32_t x;
+                if (exp == 0){
+                        if (mant == 0){
+                                x = sign;
+                        } else {
+                                int e = 1;
+                                while ((mant & 0x400) == 0){
+                                        mant <<= 1;
+                                        --e;
+                                }
+                                x = sign | ((uint32_t) (e + 112) << 23) | ((mant & 0x3ff) << 13);
+                        }
+                } else if (exp == 31){
+                        x = sign | 0x7f800000 | (mant << 13);
+                } else {
+                        x = sign | ((exp + 112) << 23) | (mant << 13);
+                }
+                float ret;
+                memcpy(&ret, &x, sizeof(ret));
+                return ret;
+        }
+
+        /**
+         * @brief Converts a float to bfloat16.
+         * @param val The value to convert
+         * @return The upper 16 bits of the float, rounded to nearest even
+         */
+        inline uint16_t floatToBfloat16(float val)
+        {
+                uint32_t x;
+                memcpy(&x, &val, sizeof(x));
+                if ((x & 0x7fffffff) > 0x7f800000){
+                        return (x >> 16) | 0x40;
+                }
+                return (x + 0x7fff + ((x >> 16) & 1)) >> 16;
+        }
+
+        /**
+         * @brief Converts bfloat16 to a float.
+         * @param val bfloat16 bits
+         * @return The value, exactly
+         */
+        inline float bfloat16ToFloat(uint16_t val)
+        {
+                uint32_t x = (uint32_t) val << 16;
+                float ret;
+                memcpy(&ret, &x, sizeof(ret));
+                return ret;
+        }
+
+        /**
+         * @brief Converts an array of doubles to half precision.
+         * @param in Values to convert
+         * @param n Number of values
+         * @param out Buffer for the half precision bits (must hold n values)
+         * @details Converts 8 values at a time with F16C when available.
+         */
+        inline void halfEncode(const double * in, unsigned int n, uint16_t * out)
+        {
+                unsigned int i = 0;
+#if defined(__F16C__) && defined(__AVX__)
+                for (; i + 8 <= n; i += 8){
+                        __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(in + i));
+                        __m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(in + i + 4));
+                        __m256 v = _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+                        _mm_storeu_si128((__m128i *) (out + i), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+                }
+#endif
+                for (; i < n; ++i){
+                        out[i] = floatToHalf((float) in[i]);
+                }
+        }
+
+        /**
+         * @brief Converts an array of half precision values to doubles.
+         * @param in Half precision bits to convert
+         * @param n Number of values
+         * @param out Buffer for the values (must hold n values)
+         * @details Converts 8 values at a time with F16C when available.
+         */
+        inline void halfDecode(const uint16_t * in, unsigned int n, double * out)
+        {
+                unsigned int i = 0;
+#if defined(__F16C__) && defined(__AVX__)
+                for (; i + 8 <= n; i += 8){
+                        __m256 v = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) (in + i)));
+                        _mm256_storeu_pd(out + i, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+                        _mm256_storeu_pd(out + i + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+                }
+#endif
+                for (; i < n; ++i){
+                        out[i] = halfToFloat(in[i]);
+                }
+        }
+
+        /**
+         * @brief Wire precision of a float array.
+         * @see ByteBuffer::writeFloatArray()
+         */
+        enum FloatPrecision {
+                FLOAT_64 = 0,   /**< Lossless doubles, 8 bytes per value. */
+                FLOAT_32 = 1,   /**< Single precision, 4 bytes per value. */
+                FLOAT_16 = 2,   /**< IEEE half precision, 2 bytes per value. */
+                BFLOAT_16 = 3,  /**< bfloat16, 2 bytes per value with the float32 range. */
+                QUANT_16 = 4,   /**< 16-bit codes scaled between the array min and max. */
+                QUANT_8 = 5     /**< 8-bit codes scaled between the array min and max. */
+        };
+
+        /**
+         * @brief Encodes bytes as lowercase hexadecimal.
+         * @param data Pointer to the bytes to encode
+         * @param size Number of bytes to encode
+         * @param out Buffer for the text (must be at least 2 * size chars)
+         * @details Converts 16 bytes at a time with SSE2 when available.
+         */
+        inline void hexEncode(const uint8_t * data, unsigned int size, char * out)
+        {
+                static const char digits[] = "0123456789abcdef";
+                unsigned int i = 0;
+#if defined(__SSE2__)
+                const __m128i nibble = _mm_set1_epi8(0x0f);
+                const __m128i nine = _mm_set1_epi8(9);
+                const __m128i zero = _mm_set1_epi8('0');
+                const __m128i alpha = _mm_set1_epi8('a' - '0' - 10);
+                for (; i + 16 <= size; i += 16){
+                        __m128i v = _mm_loadu_si128((const __m128i *) (data + i));
+                        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+                        __m128i lo = _mm_and_si128(v, nibble);
+                        __m128i first = _mm_unpacklo_epi8(hi, lo);
+                        __m128i second = _mm_unpackhi_epi8(hi, lo);
+                        first = _mm_add_epi8(_mm_add_epi8(first, zero), _mm_and_si128(_mm_cmpgt_epi8(first, nine), alpha));
+                        second = _mm_add_epi8(_mm_add_epi8(second, zero), _mm_and_si128(_mm_cmpgt_epi8(second, nine), alpha));
+                        _mm_storeu_si128((__m128i *) (out + 2 * i), first);
+                        _mm_storeu_si128((__m128i *) (out + 2 * i + 16), second);
+                }
+#endif
+                for (; i < size; ++i){
+                        out[2 * i] = digits[data[i] >> 4];
+                        out[2 * i + 1] = digits[data[i] & 0x0f];
+                }
+        }
+
+        /**
+         * @brief Gets the value of a hexadecimal digit.
+         * @param c The digit, in either case
+         * @return The value (0 to 15), or -1 if c is not a digit
+         */
+        inline int hexValue(char c)
+        {
+                if (c >= '0' && c <= '9'){
+                        return c - '0';
+                }
+                c |= 0x20;
+                if (c >= 'a' && c <= 'f'){
+                        return c - 'a' + 10;
+                }
+                return -1;
+        }
+
+        /**
+         * @brief Decodes hexadecimal text.
+         * @param text Pointer to the text, digits in either case
+         * @param size Number of chars (must be even)
+         * @param out Buffer for the bytes (must be at least size / 2 bytes)
+         * @return true if the text only holds hexadecimal digits, false otherwise
+         * @details Converts 32 chars at a time with SSE2 when available.
+         */
+        inline bool hexDecode(const char * text, unsigned int size, uint8_t * out)
+        {
+                if (size % 2 != 0){
+                        return false;
+                }
+                unsigned int i = 0;
+#if defined(__SSE2__)
+                const __m128i lower = _mm_set1_epi8(0x20);
+                const __m128i zero = _mm_set1_epi8('0');
+                const __m128i alpha = _mm_set1_epi8('a' - 10);
+                const __m128i nine = _mm_set1_epi8(9);
+                const __m128i five = _mm_set1_epi8(5);
+                const __m128i ten = _mm_set1_epi8(10);
+                const __m128i low = _mm_set1_epi16(0x00ff);
+                for (; i + 32 <= size; i += 32){
+                        __m128i words[2];
+                        for (int half=0; half < 2; ++half){
+                                __m128i c = _mm_loadu_si128((const __m128i *) (text + i + 16 * half));
+                                __m128i d = _mm_sub_epi8(c, zero);
+                                __m128i a = _mm_sub_epi8(_mm_or_si128(c, lower), alpha);
+                                __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(d, nine), d);
+                                __m128i isAlpha = _mm_cmpeq_epi8(_mm_min_epu8(_mm_sub_epi8(a, ten), five),
+                                                                 _mm_sub_epi8(a, ten));
+                                if (_mm_movemask_epi8(_mm_or_si128(isDigit, isAlpha)) != 0xffff){
+                                        return false;
+                                }
+                                __m128i v = _mm_or_si128(_mm_and_si128(isDigit, d), _mm_andnot_si128(isDigit, a));
+                                // Each 16-bit word holds the high digit in its low byte
+                                words[half] = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, low), 4),
+                                                           _mm_srli_epi16(v, 8));
+                        }
+                        _mm_storeu_si128((__m128i *) (out + i / 2), _mm_packus_epi16(words[0], words[1]));
+                }
+#endif
+                for (; i < size; i += 2){
+                        int hi = hexValue(text[i]);
+                        int lo = hexValue(text[i + 1]);
+                        if (hi < 0 || lo < 0){
+                                return false;
+                        }
+                        out[i / 2] = (uint8_t) ((hi << 4) | lo);
+                }
+                return true;
+        }
+
+        /**
+         * @brief Gets the size of the base64 text for a number of bytes.
+         * @param size Number of bytes to encode
+         * @return Number of chars, padding included
+         */
+        inline unsigned int base64Size(unsigned int size)
+        {
+                return (size + 2) / 3 * 4;
+        }
+
+        /**
+         * @brief Encodes bytes as base64 with the standard alphabet and padding.
+         * @param data Pointer to the bytes to encode
+         * @param size Number of bytes to encode
+         * @param out Buffer for the text (must be at least base64Size(size) chars)
+         * @return Number of chars written
+         * @details Encodes 12 bytes at a time with SSSE3 when available, using the
+         *          Muła/Lemire shuffle and lookup method.
+         */
+        inline unsigned int base64Encode(const uint8_t * data, unsigned int size, char * out)
+        {
+                static const char alphabet[] =
+                        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+                unsigned int i = 0, o = 0;
+#if defined(__SSSE3__)
+                const __m128i shuffle = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+                const __m128i shiftLut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                       '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                       '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+                for (; i + 16 <= size; i += 12, o += 16){
+                        __m128i in = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + i)), shuffle);
+                        // Split each 3-byte group into four 6-bit indexes
+                        __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+                        __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+                        __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+                        __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+                        __m128i idx = _mm_or_si128(t1, t3);
+                        __m128i reduced = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+                        __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+                        reduced = _mm_or_si128(reduced, _mm_and_si128(less, _mm_set1_epi8(13)));
+                        _mm_storeu_si128((__m128i *) (out + o), _mm_add_epi8(idx, _mm_shuffle_epi8(shiftLut, reduced)));
+                }
+#endif
+                for (; i + 3 <= size; i += 3, o += 4){
+                        uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+                        out[o] = alphabet[v >> 18];
+                        out[o + 1] = alphabet[(v >> 12) & 0x3f];
+                        out[o + 2] = alphabet[(v >> 6) & 0x3f];
+                        out[o + 3] = alphabet[v & 0x3f];
+                }
+                if (i < size){
+                        uint32_t v = (data[i] << 16) | (i + 1 < size ? data[i + 1] << 8 : 0);
+                        out[o] = alphabet[v >> 18];
+                        out[o + 1] = alphabet[(v >> 12) & 0x3f];
+                        out[o + 2] = (i + 1 < size ? alphabet[(v >> 6) & 0x3f] : '=');
+                        out[o + 3] = '=';
+                        o += 4;
+                }
+                return o;
+        }
+
+        /**
+         * @brief Gets the value of a base64 char.
+         * @param c The char, from the standard alphabet
+         * @return The value (0 to 63), or -1 if c is not in the alphabet
+         */
+        inline int base64Value(char c)
+        {
+                if (c >= 'A' && c <= 'Z'){
+                        return c - 'A';
+                }
+                if (c >= 'a' && c <= 'z'){
+                        return c - 'a' + 26;
+                }
+                if (c >= '0' && c <= '9'){
+                        return c - '0' + 52;
+                }
+                if (c == '+'){
+                        return 62;
+                }
+                if (c == '/'){
+                        return 63;
+                }
+                return -1;
+        }
+
+        /**
+         * @brief Decodes base64 text with the standard alphabet and padding.
+         * @param text Pointer to the text
+         * @param size Number of chars (must be a multiple of 4)
+         * @param out Buffer for the bytes (must be at least size / 4 * 3 bytes)
+         * @param written Reference to store the number of bytes decoded
+         * @return true if the text is valid base64, false otherwise
+         * @details Decodes 16 chars at a time with SSSE3 when available, validating
+         *          them with nibble lookup tables.
+         */
+        inline bool base64Decode(const char * text, unsigned int size, uint8_t * out, unsigned int& written)
+        {
+                written = 0;
+                if (size % 4 != 0){
+                        return false;
+                }
+                unsigned int i = 0, o = 0;
+#if defined(__SSSE3__)
+                const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                                    0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+                const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                                    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+                const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+                const __m128i mask2F = _mm_set1_epi8(0x2f);
+                // 24 chars left guarantee room for the 16-byte store
+                for (; i + 24 <= size; i += 16, o += 12){
+                        __m128i str = _mm_loadu_si128((const __m128i *) (text + i));
+                        __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask2F);
+                        __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+                        __m128i lo = _mm_shuffle_epi8(lutLo, _mm_and_si128(str, mask2F));
+                        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xffff){
+                                break;
+                        }
+                        __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(str, mask2F), hiNibbles));
+                        str = _mm_add_epi8(str, roll);
+                        // Merge four 6-bit values into three bytes
+                        str = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+                        str = _mm_madd_epi16(str, _mm_set1_epi32(0x00011000));
+                        str = _mm_shuffle_epi8(str, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+                        _mm_storeu_si128((__m128i *) (out + o), str);
+                }
+#endif
+                for (; i < size; i += 4){
+                        int a = base64Value(text[i]);
+                        int b = base64Value(text[i + 1]);
+                        int c = base64Value(text[i + 2]);
+                        int d = base64Value(text[i + 3]);
+                        bool last = (i + 4 == size);
+                        if (a < 0 || b < 0){
+                                return false;
+                        }
+                        if (last && text[i + 2] == '=' && text[i + 3] == '='){
+                                out[o++] = (uint8_t) ((a << 2) | (b >> 4));
+                                break;
+                        }
+                        if (c < 0){
+                                return false;
+                        }
+                        if (last && text[i + 3] == '='){
+                                out[o++] = (uint8_t) ((a << 2) | (b >> 4));
+                                out[o++] = (uint8_t) ((b << 4) | (c >> 2));
+                                break;
+                        }
+                        if (d < 0){
+                                return false;
+                        }
+                        out[o++] = (uint8_t) ((a << 2) | (b >> 4));
+                        out[o++] = (uint8_t) ((b << 4) | (c >> 2));
+                        out[o++] = (uint8_t) ((c << 6) | d);
+                }
+                written = o;
+                return true;
+        }
+
+        /**
+         * @brief Writes a stream of bit fields, most significant bit first.
+         * @details Bits are gathered in a 64-bit accumulator that is stored as a
+         *          big-endian word each time it fills up, so most writes are a shift
+         *          and an or. Embed the stream in a message with ByteBuffer::writeBits().
+         */
+        class BitWriter
+        {
+        public:
+                /**
+                 * @brief Constructs an empty stream.
+                 */
+                BitWriter() : acc(0), accBits(0) {}
+
+                /**
+                 * @brief Appends the low bits of a value.
+                 * @param val The value to write
+                 * @param bits Number of low bits of val to write (0 to 64)
+                 */
+                void writeBits(uint64_t val, unsigned int bits)
+                {
+                        if (bits < 64){
+                                val &= ((uint64_t) 1 << bits) - 1;
+                        }
+                        unsigned int free = 64 - accBits;
+                        if (bits < free){
+                                acc = (acc << bits) | val;
+                                accBits += bits;
+                                return;
+                        }
+                        // Fill the accumulator, store it and keep the remaining bits
+                        unsigned int rem = bits - free;
+                        uint64_t word = (accBits == 0 ? 0 : acc << free) | (val >> rem);
+                        words.resize(words.size() + sizeof(uint64_t));
+                        be64encode(word, &words[words.size() - sizeof(uint64_t)]);
+                        acc = (rem == 0 ? 0 : val & (((uint64_t) 1 << rem) - 1));
+                        accBits = rem;
+                }
+
+                /**
+                 * @brief Appends a single bit.
+                 * @param val The bit to write
+                 */
+                void writeBit(bool val) {writeBits(val ? 1 : 0, 1);}
+
+                /**
+                 * @brief Gets the size of the stream.
+                 * @return Size in bytes, the last byte padded with zeros
+                 */
+                unsigned int size() const {return words.size() + (accBits + 7) / 8;}
+                /**
+                 * @brief Gets the number of bits written.
+                 * @return Size of the stream in bits
+                 */
+                uint64_t bitCount() const {return (uint64_t) words.size() * 8 + accBits;}
+
+                /**
+                 * @brief Copies the stream to a buffer.
+                 * @param out Destination buffer (must be at least size() bytes)
+                 * @return Number of bytes copied
+                 */
+                unsigned int copy(uint8_t * out) const
+                {
+                        std::copy(words.begin(), words.end(), out);
+                        out += words.size();
+                        uint64_t tail = (accBits == 0 ? 0 : acc << (64 - accBits));
+                        for (unsigned int i=0; i < (accBits + 7) / 8; ++i){
+                                out[i] = (tail >> (56 - 8 * i)) & 0xff;
+                        }
+                        return size();
+                }
+
+                /**
+                 * @brief Clears the stream.
+                 */
+                void clear() {words.clear(); acc = 0; accBits = 0;}
+
+        protected:
+                std::vector<uint8_t> words;
+                uint64_t acc;
+                unsigned int accBits;
+        };
+
+        /**
+         * @brief Reads a stream of bit fields written by BitWriter.
+         * @details Each read loads the 8 bytes around the current bit position as a
+         *          big-endian word and extracts the field with two shifts, without
+         *          per-bit or per-byte branches. Only the last 8 bytes of the stream
+         *          take a slower bounds-checked load. The data must outlive the reader.
+         */
+        class BitReader
+        {
+        public:
+                /**
+                 * @brief Constructs a reader over an empty stream.
+                 */
+                BitReader() : ptr(NULL), len(0), bit(0) {}
+
+                /**
+                 * @brief Constructs a reader over existing bytes.
+                 * @param data Pointer to the stream
+                 * @param size Size of the stream in bytes
+                 */
+                BitReader(const uint8_t * data, unsigned int size) : ptr(data), len(size), bit(0) {}
+
+                /**
+                 * @brief Reads a bit field.
+                 * @param bits Number of bits to read (0 to 64)
+                 * @return The value, in the low bits
+                 */
+                uint64_t readBits(unsigned int bits)
+                {
+                        WIRECC_ASSERT(bit + bits <= (uint64_t) len * 8);
+                        if (bits > 56){
+                                uint64_t high = readBits(bits - 32);
+                                return (high << 32) | readBits(32);
+                        }
+                        if (bits == 0){
+                                return 0;
+                        }
+                        uint64_t word = load(bit / 8) << (bit % 8);
+                        bit += bits;
+                        return word >> (64 - bits);
+                }
+
+                /**
+                 * @brief Reads a single bit.
+                 * @return The bit
+                 */
+                bool readBit() {return (readBits(1) != 0);}
+
+                /**
+                 * @brief Gets the number of bits read.
+                 * @return Position in the stream, in bits
+                 */
+                uint64_t getBitPos() const {return bit;}
+
+        protected:
+                uint64_t load(uint64_t at) const
+                {
+                        if (at + sizeof(uint64_t) <= len){
+                                return be64decode(ptr + at);
+                        }
+                        uint8_t tmp[sizeof(uint64_t)] = {0};
+                        for (uint64_t i = at; i < len; ++i){
+                                tmp[i - at] = ptr[i];
+                        }
+                        return be64decode(tmp);
+                }
+
+                const uint8_t * ptr;
+                unsigned int len;
+                uint64_t bit;
+        };
+
+        /**
+         * @brief A per-stream table of interned strings.
+         * @details Used with ByteBuffer::writeString(const std::string&, StringTable&)
+         *          on the encoding side and readString(ByteView&, StringTable&) on the decoding
+         *          side, each stream end keeping its own table. The first use of a
+         *          string sends it with a new id, later uses send only the varint id.
+         *          Once the table is full, new strings are sent in full without
+         *          being interned.
+         */
+        class StringTable
+        {
+        public:
+                /** @brief Tag of a reference to an interned string. */
+                static const unsigned int STRING_REF = 0;
+                /** @brief Tag of a string interned under a new id. */
+                static const unsigned int STRING_DEFINE = 1;
+                /** @brief Tag of a string sent without being interned. */
+                static const unsigned int STRING_LITERAL = 2;
+
+                /**
+                 * @brief Constructs an empty table.
+                 * @param maxEntries Maximum number of interned strings
+                 */
+                explicit StringTable(unsigned int maxEntries=65536) : maxSize(maxEntries) {}
+
+                /**
+                 * @brief Looks up the id of an interned string.
+                 * @param val The string to look up
+                 * @param id Reference to store the id
+                 * @return true if the string is interned, false otherwise
+                 */
+                bool find(const std::string& val, unsigned int& id) const
+                {
+                        std::unordered_map<std::string, unsigned int>::const_iterator itr = ids.find(val);
+                        if (itr != ids.end()){
+                                id = itr->second;
+                                return true;
+                        }
+                        return false;
+                }
+
+                /**
+                 * @brief Interns a string on the encoding side.
+                 * @param val The string to intern
+                 * @param id Reference to store the new id
+                 * @return true if interned, false if the table is full
+                 */
+                bool add(const std::string& val, unsigned int& id)
+                {
+                        if (ids.size() >= maxSize){
+                                return false;
+                        }
+                        id = ids.size();
+                        ids.insert(std::make_pair(val, id));
+                        return true;
+                }
+
+                /**
+                 * @brief Interns a string received from the encoding side.
+                 * @param id The id sent by the encoder
+                 * @param data Pointer to the string bytes
+                 * @param size Size of the string in bytes
+                 * @return The interned string, valid until clear(), or NULL if id is
+                 *         not the next id or the table is full
+                 */
+                const std::string * define(unsigned int id, const uint8_t * data, unsigned int size)
+                {
+                        if (id != strings.size() || strings.size() >= maxSize){
+                                return NULL;
+                        }
+                        strings.push_back(std::string((const char *) data, size));
+                        return &strings.back();
+                }
+
+                /**
+                 * @brief Gets a string received from the encoding side.
+                 * @param id The id of the string
+                 * @return The interned string, valid until clear(), or NULL if id was
+                 *         never defined
+                 */
+                const std::string * get(unsigned int id) const
+                {
+                        return (id < strings.size() ? &strings[id] : NULL);
+                }
+
+                /**
+                 * @brief Gets the number of interned strings.
+                 * @return Number of entries on the side the table is used for
+                 */
+                unsigned int size() const {return ids.size() + strings.size();}
+
+                /**
+                 * @brief Removes every interned string.
+                 */
+                void clear()
+                {
+                        ids.clear();
+                        strings.clear();
+                }
+
+        protected:
+                std::unordered_map<std::string, unsigned int> ids;
+                std::deque<std::string> strings;
+                unsigned int maxSize;
+        };
+
+        /**
+         * @brief Hashes a ResourceId to 64 well-mixed bits.
+         * @param rid The id to hash
+         * @param seed Seed mixed into the hash
+         * @return The 64-bit hash, every input bit affecting every output bit
+         */
+        inline uint64_t hashId(ResourceId rid, uint64_t seed=0)
+        {
+                uint64_t x = (uint32_t) rid + seed + 0x9E3779B97F4A7C15ULL;
+                x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+                return x ^ (x >> 31);
+        }
+
+        /**
+         * @brief A persistent ResourceSet with structural sharing.
+         * @details Stored as a treap whose node priorities are a hash of the id,
+         *          seeded per set so that no choice of ids can unbalance the tree.
+         *          Nodes are immutable and shared: insert() and erase() copy only
+         *          the O(log n) nodes on the path to the id, and copying the set is
+         *          an O(1) snapshot that later updates of either copy don't affect.
+         *          Snapshots can be read from several threads while a writer keeps
+         *          updating its own copy.
+         */
+        class PersistentResourceSet
+        {
+        protected:
+                struct Node;
+                typedef std::shared_ptr<const Node> NodePtr;
+                struct Node
+                {
+                        Node(ResourceId key, uint32_t prio, const NodePtr& left, const NodePtr& right)
+                                : key(key), prio(prio), left(left), right(right) {}
+                        ResourceId key;
+                        uint32_t prio;
+                        NodePtr left, right;
+                };
+
+        public:
+                /**
+                 * @brief Iterates the ids of the set in increasing order.
+                 * @details Valid for as long as the set it came from, or a copy of it, exists.
+                 */
+                class const_iterator
+                {
+                public:
+                        typedef std::forward_iterator_tag iterator_category;
+                        typedef ResourceId value_type;
+                        typedef std::ptrdiff_t difference_type;
+                        typedef const ResourceId * pointer;
+                        typedef const ResourceId & reference;
+
+                        const_iterator() {}
+                        reference operator*() const {return path.back()->key;}
+                        pointer operator->() const {return &path.back()->key;}
+                        const_iterator& operator++()
+                        {
+                                const Node * node = path.back();
+                                path.pop_back();
+                                descend(node->right.get());
+                                return *this;
+                        }
+                        const_iterator operator++(int)
+                        {
+                                const_iterator ret = *this;
+                                ++(*this);
+                                return ret;
+                        }
+                        bool operator==(const const_iterator& other) const
+                        {
+                                return (path.empty() ? other.path.empty() :
+                                        (!other.path.empty() && path.back() == other.path.back()));
+                        }
+                        bool operator!=(const const_iterator& other) const {return !(*this == other);}
+
+                protected:
+                        friend class PersistentResourceSet;
+                        void descend(const Node * node)
+                        {
+                                for (; node; node = node->left.get()){
+                                        path.push_back(node);
+                                }
+                        }
+                        std::vector<const Node *> path;
+                };
+
+                /**
+                 * @brief Constructs an empty set.
+                 */
+                PersistentResourceSet() : count(0), seed(newSeed()) {}
+
+                /**
+                 * @brief Constructs a set holding the ids of a ResourceSet.
+                 * @param val The set to copy, in O(n)
+                 */
+                explicit PersistentResourceSet(const ResourceSet& val) : count(0), seed(newSeed()) {assign(val);}
+
+                /**
+                 * @brief Replaces the contents with the ids of a ResourceSet.
+                 * @param val The set to copy, in O(n)
+                 */
+                void assign(const ResourceSet& val)
+                {
+                        FlatResourceSet ids(val.begin(), val.end());
+                        assign(ids);
+                }
+
+                /**
+                 * @brief Replaces the contents with the ids of a flat set.
+                 * @param ids The ids, sorted and deduplicated in place if needed
+                 * @details Builds the treap bottom-up in O(n) for sorted ids.
+                 */
+                void assign(FlatResourceSet& ids)
+                {
+                        if (std::adjacent_find(ids.begin(), ids.end(), std::greater_equal<ResourceId>()) != ids.end()){
+                                sortResourceIds(ids);
+                        }
+                        // Nodes are only mutated here, before the tree is published.
+                        std::vector<std::shared_ptr<Node> > spine;
+                        for (size_t i=0; i < ids.size(); ++i){
+                                std::shared_ptr<Node> node = std::make_shared<Node>(ids[i], priority(ids[i]), NodePtr(), NodePtr());
+                                std::shared_ptr<Node> last;
+                                while (!spine.empty() && spine.back()->prio < node->prio){
+                                        last = spine.back();
+                                        spine.pop_back();
+                                }
+                                node->left = last;
+                                if (!spine.empty()){
+                                        spine.back()->right = node;
+                                }
+                                spine.push_back(node);
+                        }
+                        root = (spine.empty() ? NodePtr() : NodePtr(spine.front()));
+                        count = ids.size();
+                }
+
+                /**
+                 * @brief Adds an id to the set.
+                 * @param id The id to add
+                 * @return true if the id was added, false if already present
+                 */
+                bool insert(ResourceId id)
+                {
+                        NodePtr tmp = insert(root, id, priority(id));
+                        if (tmp == root){
+                                return false;
+                        }
+                        root = tmp;
+                        ++count;
+                        return true;
+                }
+
+                /**
+                 * @brief Removes an id from the set.
+                 * @param id The id to remove
+                 * @return true if the id was removed, false if not present
+                 */
+                bool erase(ResourceId id)
+                {
+                        bool found = false;
+                        NodePtr tmp = erase(root, id, found);
+                        if (!found){
+                                return false;
+                        }
+                        root = tmp;
+                        --count;
+                        return true;
+                }
+
+                /**
+                 * @brief Checks whether an id is in the set.
+                 * @param id The id to look up
+                 * @return true if present, false otherwise
+                 */
+                bool contains(ResourceId id) const
+                {
+                        const Node * node = root.get();
+                        while (node && node->key != id){
+                                node = (id < node->key ? node->left.get() : node->right.get());
+                        }
+                        return (node != NULL);
+                }
+
+                /**
+                 * @brief Gets the number of ids in the set.
+                 * @return Number of ids
+                 */
+                size_t size() const {return count;}
+                /**
+                 * @brief Checks whether the set is empty.
+                 * @return true if empty, false otherwise
+                 */
+                bool empty() const {return (count == 0);}
+                /**
+                 * @brief Removes all ids.
+                 */
+                void clear() {root.reset(); count = 0;}
+
+                /**
+                 * @brief Gets an iterator to the smallest id.
+                 * @return Iterator, equal to end() if the set is empty
+                 */
+                const_iterator begin() const
+                {
+                        const_iterator ret;
+                        ret.descend(root.get());
+                        return ret;
+                }
+                /**
+                 * @brief Gets the past-the-end iterator.
+                 * @return Iterator past the largest id
+                 */
+                const_iterator end() const {return const_iterator();}
+
+        protected:
+                static uint64_t newSeed()
+                {
+                        static const uint64_t base = ((uint64_t) std::random_device()() << 32) ^ std::random_device()();
+                        static std::atomic<uint32_t> next(0);
+                        return hashId((ResourceId) next.fetch_add(1, std::memory_order_relaxed), base);
+                }
+
+                uint32_t priority(ResourceId key) const
+                {
+                        return (uint32_t) hashId(key, seed);
+                }
+
+                static NodePtr insert(const NodePtr& node, ResourceId id, uint32_t prio)
+                {
+                        if (!node){
+                                return std::make_shared<const Node>(id, prio, NodePtr(), NodePtr());
+                        }
+                        if (id < node->key){
+                                NodePtr left = insert(node->left, id, prio);
+                                if (left == node->left){
+                                        return node;
+                                }
+                                if (left->prio > node->prio){
+                                        NodePtr down = std::make_shared<const Node>(node->key, node->prio, left->right, node->right);
+                                        return std::make_shared<const Node>(left->key, left->prio, left->left, down);
+                                }
+                                return std::make_shared<const Node>(node->key, node->prio, left, node->right);
+                        }
+                        if (id > node->key){
+                                NodePtr right = insert(node->right, id, prio);
+                                if (right == node->right){
+                                        return node;
+                                }
+                                if (right->prio > node->prio){
+                                        NodePtr down = std::make_shared<const Node>(node->key, node->prio, node->left, right->left);
+                                        return std::make_shared<const Node>(right->key, right->prio, down, right->right);
+                                }
+                                return std::make_shared<const Node>(node->key, node->prio, node->left, right);
+                        }
+                        return node;
+                }
+
+                static NodePtr erase(const NodePtr& node, ResourceId id, bool& found)
+                {
+                        if (!node){
+                                return node;
+                        }
+                        if (id < node->key){
+                                NodePtr left = erase(node->left, id, found);
+                                return (found ? std::make_shared<const Node>(node->key, node->prio, left, node->right) : node);
+                        }
+                        if (id > node->key){
+                                NodePtr right = erase(node->right, id, found);
+                                return (found ? std::make_shared<const Node>(node->key, node->prio, node->left, right) : node);
+                        }
+                        found = true;
+                        return merge(node->left, node->right);
+                }
+
+                static NodePtr merge(const NodePtr& lo, const NodePtr& hi)
+                {
+                        if (!lo || !hi){
+                                return (lo ? lo : hi);
+                        }
+                        if (lo->prio > hi->prio){
+                                return std::make_shared<const Node>(lo->key, lo->prio, lo->left, merge(lo->right, hi));
+                        }
+                        return std::make_shared<const Node>(hi->key, hi->prio, merge(lo, hi->left), hi->right);
+                }
+
+                NodePtr root;
+                size_t count;
+                uint64_t seed;
+        };
+        typedef Iterator<PersistentResourceSet> PersistentResourceIterator;
+
+        class ResourceSetPool;
+
+        /**
+         * @brief A read-only view over encoded bytes.
+         * @details Decodes the same wire format as ByteBuffer without owning or
+         *          copying the underlying data, which must outlive the view.
+         */
+        class ByteView
+        {
+        public:
+                /**
+                 * @brief Constructs an empty view.
+                 */
+                ByteView() : ptr(NULL), len(0), pos(0) {}
+
+                /**
+                 * @brief Constructs a view over existing bytes.
+                 * @param data Pointer to the first byte
+                 * @param size Number of bytes in the view
+                 */
+                ByteView(const uint8_t * data, unsigned int size) : ptr(data), len(size), pos(0) {}
+
+                /**
+                 * @brief Reads a nested buffer as a view, without copying it.
+                 * @param view The view to point at the nested buffer
+                 */
+                void readBuffer(ByteView& view)
+                {
+                        unsigned int size;
+                        readUint(size);
+                        view = ByteView(ptr + pos, size);
+                        pos += size;
+                }
+
+                /**
+                 * @brief Reads a bit stream written by ByteBuffer::writeBits(), without copying it.
+                 * @param reader The reader to point at the stream
+                 */
+                void readBits(BitReader& reader)
+                {
+                        unsigned int size;
+                        readUint(size);
+                        reader = BitReader(ptr + pos, size);
+                        pos += size;
+                }
+
+                /**
+                 * @brief Skips a nested buffer.
+                 */
+                void skipBuffer()
+                {
+                        unsigned int size;
+                        readUint(size);
+                        pos += size;
+                }
+
+                /**
+                 * @brief Reads a 64-bit unsigned integer.
+                 * @param val Reference to store the read value
+                 */
+                void readU64(uint64_t& val)
+                {
+                        val = be64decode(ptr + pos);
+                        pos += sizeof(uint64_t);
+                }
+
+                /**
+                 * @brief Skips a 64-bit unsigned integer.
+                 */
+                void skipU64() {pos += sizeof(uint64_t);}
+
+                /**
+                 * @brief Reads a double.
+                 * @param val Reference to store the read value
+                 */
+                void readDouble(double& val)
+                {
+                        uint64_t bits;
+                        readU64(bits);
+                        memcpy(&val, &bits, sizeof(val));
+                }
+
+                /**
+                 * @brief Reads an unsigned integer.
+                 * @param val Reference to store the read value
+                 */
+                void readUint(unsigned int& val)
+                {
+                        val = be32decode(ptr + pos);
+                        pos += sizeof(uint32_t);
+                }
+
+                /**
+                 * @brief Skips an unsigned integer.
+                 */
+                void skipUint() {pos += sizeof(uint32_t);}
+
+                /**
+                 * @brief Reads a signed integer.
+                 * @param val Reference to store the read value
+                 */
+                void readInt(int& val)
+                {
+                        unsigned int tmp;
+                        readUint(tmp);
+                        val = tmp;
+                }
+
+                /**
+                 * @brief Skips a signed integer.
+                 */
+                void skipInt() {skipUint();}
+
+                /**
+                 * @brief Reads a ResourceSet.
+                 * @param val Reference to the ResourceSet to populate
+                 */
+                void readRset(ResourceSet& val)
+                {
+                        uint32_t size;
+                        readUint(size);
+                        while (size-- > 0){
+                                ResourceId r;
+                                readInt(r);
+                                val.insert(val.end(), r);
+                        }
+                }
+
+                /**
+                 * @brief Reads a ResourceSet into a persistent set.
+                 * @param val Reference to the set to populate, its contents are replaced
+                 */
+                void readRset(PersistentResourceSet& val)
+                {
+                        uint32_t size;
+                        readUint(size);
+                        FlatResourceSet ids(size);
+                        for (uint32_t i=0; i < size; ++i){
+                                readInt(ids[i]);
+                        }
+                        val.assign(ids);
+                }
+
+                /**
+                 * @brief Reads a ResourceSet as an interned flat set.
+                 * @param pool Pool the set is interned in
+                 * @param val Receives the shared instance
+                 */
+                void readRset(ResourceSetPool& pool, SharedResourceSet& val);
+
+                /**
+                 * @brief Skips a ResourceSet without building it.
+                 */
+                void skipRset()
+                {
+                        uint32_t size;
+                        readUint(size);
+                        pos += size * sizeof(uint32_t);
+                }
+
+                /**
+                 * @brief Reads a string.
+                 * @param val Reference to the string to populate
+                 */
+                void readString(std::string& val)
+                {
+                        uint32_t size;
+                        readUint(size);
+                        val.append((const char *) ptr + pos, size);
+                        pos += size;
+                }
+
+                /**
+                 * @brief Reads a string, checking that it is valid UTF-8.
+                 * @param val Reference to the string to append to, unchanged on failure
+                 * @return true if the string is valid UTF-8, false otherwise
+                 * @details The string is skipped either way.
+                 */
+                bool readUtf8String(std::string& val)
+                {
+                        uint32_t size;
+                        readUint(size);
+                        unsigned int old = val.size();
+                        val.resize(old + size);
+                        bool ok = utf8Copy(ptr + pos, size, (uint8_t *) &val[0] + old);
+                        if (!ok){
+                                val.resize(old);
+                        }
+                        pos += size;
+                        return ok;
+                }
+
+                /**
+                 * @brief Skips a string without allocating it.
+                 */
+                void skipString()
+                {
+                        uint32_t size;
+                        readUint(size);
+                        pos += size;
+                }
+
+                /**
+                 * @brief Reads a string written against a StringTable, without copying it.
+                 * @param val The view to point at the string bytes, owned by the table
+                 *        for interned strings and by the viewed data for literals
+                 * @param table The decoding side table of the stream
+                 * @return true if the string was read, false if it refers to an id
+                 *         that is unknown, out of order or past the table size
+                 * @see ByteBuffer::writeString(const std::string&, StringTable&)
+                 */
+                bool readString(ByteView& val, StringTable& table)
+                {
+                        uint64_t head, size;
+                        readVarint(head);
+                        unsigned int kind = head & 3;
+                        if ((head >> 2) > UINT32_MAX || kind > StringTable::STRING_LITERAL){
+                                return false;
+                        }
+                        const std::string * str = NULL;
+                        if (kind == StringTable::STRING_REF){
+                                str = table.get(head >> 2);
+                                if (!str){
+                                        return false;
+                                }
+                                val = ByteView((const uint8_t *) str->data(), str->size());
+                                return true;
+                        }
+                        readVarint(size);
+                        if (pos > len || size > len - pos){
+                                return false;
+                        }
+                        const uint8_t * data = ptr + pos;
+                        pos += size;
+                        if (kind == StringTable::STRING_DEFINE){
+                                str = table.define(head >> 2, data, size);
+                                if (!str){
+                                        return false;
+                                }
+                                data = (const uint8_t *) str->data();
+                        }
+                        val = ByteView(data, size);
+                        return true;
+                }
+
+                /**
+                 * @brief Reads a string written against a StringTable into a string.
+                 * @param val Reference to store the read string
+                 * @param table The decoding side table of the stream
+                 * @return true if the string was read, false otherwise
+                 * @see readString(ByteView&, StringTable&)
+                 */
+                bool readString(std::string& val, StringTable& table)
+                {
+                        ByteView str;
+                        if (!readString(str, table)){
+                                return false;
+                        }
+                        val.assign((const char *) str.data(), str.size());
+                        return true;
+                }
+
+                /**
+                 * @brief Reads a boolean value.
+                 * @param val Reference to store the read boolean value
+                 */
+                void readBool(bool& val)
+                {
+                        val = (ptr[pos] != 0);
+                        ++pos;
+                }
+
+                /**
+                 * @brief Skips a boolean value.
+                 */
+                void skipBool() {++pos;}
+
+                /**
+                 * @brief Reads a varint.
+                 * @param val Reference to store the read value
+                 */
+                void readVarint(uint64_t& val)
+                {
+                        pos += varintDecode(ptr + pos, val);
+                }
+
+                /**
+                 * @brief Skips a varint.
+                 */
+                void skipVarint() {pos += varintLength(ptr + pos);}
+
+                /**
+                 * @brief Reads a tagged field header and its value.
+                 * @param tag Reference to store the field tag
+                 * @param value The view to point at the field value
+                 * @see ByteBuffer::beginTagged()
+                 */
+                void readTagged(unsigned int& tag, ByteView& value)
+                {
+                        uint64_t tmp, size;
+                        readVarint(tmp);
+                        readVarint(size);
+                        tag = tmp;
+                        value = ByteView(ptr + pos, size);
+                        pos += size;
+                }
+
+                /**
+                 * @brief Dumps the viewed bytes as lowercase hexadecimal.
+                 * @return The text, two chars per byte
+                 */
+                std::string toHex() const
+                {
+                        std::string ret(2 * len, '\0');
+                        hexEncode(ptr, len, &ret[0]);
+                        return ret;
+                }
+
+                /**
+                 * @brief Encodes the viewed bytes as base64.
+                 * @return The text, with padding
+                 */
+                std::string toBase64() const
+                {
+                        std::string ret(base64Size(len), '\0');
+                        base64Encode(ptr, len, &ret[0]);
+                        return ret;
+                }
+
+                /**
+                 * @brief Gets a pointer to the viewed data.
+                 * @return Const pointer to the first byte of the view
+                 */
+                const uint8_t * data() const {return ptr;}
+                /**
+                 * @brief Gets the size of the view.
+                 * @return Size of the view in bytes
+                 */
+                unsigned int size() const {return len;}
+                /**
+                 * @brief Sets the current position in the view.
+                 * @param newPos The new position to set
+                 */
+                void setPos(unsigned int newPos) {pos = newPos;}
+                /**
+                 * @brief Gets the current position in the view.
+                 * @return Current position in bytes
+                 */
+                unsigned int getPos() const {return pos;}
+
+        protected:
+                const uint8_t * ptr;
+                unsigned int len;
+                unsigned int pos;
+        };
+
+        /**
+         * @brief Decodes a 64-bit unsigned integer from little-endian byte array.
+         * @param buf Buffer containing the encoded bytes (must be at least 8 bytes)
+         * @return The decoded 64-bit unsigned integer
+         */
+        inline uint64_t le64decode(const uint8_t * buf)
+        {
+                return ((uint64_t)buf[0] | ((uint64_t)buf[1]<<8) |
+                        ((uint64_t)buf[2]<<16) | ((uint64_t)buf[3]<<24) |
+                        ((uint64_t)buf[4]<<32) | ((uint64_t)buf[5]<<40) |
+                        ((uint64_t)buf[6]<<48) | ((uint64_t)buf[7]<<56));
+        }
+
+        /**
+         * @brief Decodes a 32-bit unsigned integer from little-endian byte array.
+         * @param buf Buffer containing the encoded bytes (must be at least 4 bytes)
+         * @return The decoded 32-bit unsigned integer
+         */
+        inline uint32_t le32decode(const uint8_t * buf)
+        {
+                return ((uint32_t)buf[0] | ((uint32_t)buf[1]<<8) |
+                        ((uint32_t)buf[2]<<16) | ((uint32_t)buf[3]<<24));
+        }
+
+        class ByteBuffer;
+
+        /**
+         * @brief Computes a 64-bit non-cryptographic hash incrementally.
+         * @details Implements XXH64: 32-byte stripes are consumed by four independent
+         *          multiply-rotate lanes, so long inputs hash at several bytes per
+         *          cycle. Feeding the same bytes in any number of update() calls gives
+         *          the same digest as hashBytes().
+         */
+        class Hasher
+        {
+        public:
+                /**
+                 * @brief Constructs a hasher.
+                 * @param seed Seed mixed into the digest
+                 */
+                explicit Hasher(uint64_t seed=0) {reset(seed);}
+
+                /**
+                 * @brief Restarts the hash.
+                 * @param seed Seed mixed into the digest
+                 */
+                void reset(uint64_t seed=0)
+                {
+                        lanes[0] = seed + P1 + P2;
+                        lanes[1] = seed + P2;
+                        lanes[2] = seed;
+                        lanes[3] = seed - P1;
+                        start = seed;
+                        total = 0;
+                        pending = 0;
+                }
+
+                /**
+                 * @brief Feeds bytes to the hash.
+                 * @param data Pointer to the bytes
+                 * @param size Number of bytes
+                 */
+                void update(const uint8_t * data, size_t size)
+                {
+                        total += size;
+                        if (pending > 0){
+                                size_t take = std::min(size, (size_t) 32 - pending);
+                                std::copy(data, data + take, stripe + pending);
+                                pending += take;
+                                data += take;
+                                size -= take;
+                                if (pending < 32){
+                                        return;
+                                }
+                                consume(stripe);
+                                pending = 0;
+                        }
+                        for (; size >= 32; data += 32, size -= 32){
+                                consume(data);
+                        }
+                        std::copy(data, data + size, stripe);
+                        pending = size;
+                }
+
+                /**
+                 * @brief Feeds the bytes of a view to the hash.
+                 * @param view The bytes to feed
+                 */
+                void update(const ByteView& view) {update(view.data(), view.size());}
+
+                /**
+                 * @brief Feeds the bytes appended to a buffer since a mark.
+                 * @param buffer The buffer being written
+                 * @param mark Position up to which the buffer was already fed, moved to its end
+                 * @details Call it between writes to hash a message while it is encoded.
+                 */
+                void update(const ByteBuffer& buffer, unsigned int& mark);
+
+                /**
+                 * @brief Gets the hash of the bytes fed so far.
+                 * @return The 64-bit digest
+                 */
+                uint64_t digest() const
+                {
+                        uint64_t h;
+                        if (total >= 32){
+                                h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+                                for (int i=0; i < 4; ++i){
+                                        h = (h ^ round(0, lanes[i])) * P1 + P4;
+                                }
+                        } else {
+                                h = start + P5;
+                        }
+                        h += total;
+                        const uint8_t * p = stripe;
+                        size_t left = pending;
+                        for (; left >= 8; p += 8, left -= 8){
+                                h = rotl(h ^ round(0, le64decode(p)), 27) * P1 + P4;
+                        }
+                        if (left >= 4){
+                                h = rotl(h ^ (le32decode(p) * P1), 23) * P2 + P3;
+                                p += 4;
+                                left -= 4;
+                        }
+                        for (; left > 0; ++p, --left){
+                                h = rotl(h ^ (*p * P5), 11) * P1;
+                        }
+                        h ^= h >> 33;
+                        h *= P2;
+                        h ^= h >> 29;
+                        h *= P3;
+                        h ^= h >> 32;
+                        return h;
+                }
+
+        protected:
+                static const uint64_t P1 = 0x9E3779B185EBCA87ULL;
+                static const uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+                static const uint64_t P3 = 0x165667B19E3779F9ULL;
+                static const uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+                static const uint64_t P5 = 0x27D4EB2F165667C5ULL;
+
+                static uint64_t rotl(uint64_t x, int r) {return (x << r) | (x >> (64 - r));}
+                static uint64_t round(uint64_t acc, uint64_t input) {return rotl(acc + input * P2, 31) * P1;}
+
+                void consume(const uint8_t * p)
+                {
+                        lanes[0] = round(lanes[0], le64decode(p));
+                        lanes[1] = round(lanes[1], le64decode(p + 8));
+                        lanes[2] = round(lanes[2], le64decode(p + 16));
+                        lanes[3] = round(lanes[3], le64decode(p + 24));
+                }
+
+                uint64_t lanes[4];
+                uint64_t start, total;
+                uint8_t stripe[32];
+                size_t pending;
+        };
+
+        /**
+         * @brief Hashes bytes with the same function as Hasher.
+         * @param data Pointer to the bytes
+         * @param size Number of bytes
+         * @param seed Seed mixed into the digest
+         * @return The 64-bit digest
+         */
+        inline uint64_t hashBytes(const uint8_t * data, size_t size, uint64_t seed=0)
+        {
+                Hasher h(seed);
+                h.update(data, size);
+                return h.digest();
+        }
+
+        /**
+         * @brief Interns ResourceSets as shared, immutable flat sets.
+         * @details Equal sets interned in the same pool share one instance, so
+         *          entities holding identical sets cost a single allocation and
+         *          comparing two interned sets is a pointer comparison. Sets are
+         *          found by a hash of their ids.
+         */
+        class ResourceSetPool
+        {
+        public:
+                /**
+                 * @brief Constructs an empty pool.
+                 */
+                ResourceSetPool() {}
+
+                /**
+                 * @brief Gets the interned instance of a set.
+                 * @param val The set to intern
+                 * @return Shared instance holding the ids of the set
+                 */
+                SharedResourceSet intern(const ResourceSet& val)
+                {
+                        FlatResourceSet flat(val.begin(), val.end());
+                        return intern(flat);
+                }
+
+                /**
+                 * @brief Gets the interned instance of a flat set.
+                 * @param val The ids to intern, sorted and deduplicated in place if needed
+                 * @return Shared instance holding the ids
+                 */
+                SharedResourceSet intern(FlatResourceSet& val)
+                {
+                        if (std::adjacent_find(val.begin(), val.end(), std::greater_equal<ResourceId>()) != val.end()){
+                                sortResourceIds(val);
+                        }
+                        uint64_t key = hashBytes(reinterpret_cast<const uint8_t *>(val.data()), val.size() * sizeof(ResourceId));
+                        std::pair<Sets::iterator, Sets::iterator> range = sets.equal_range(key);
+                        for (Sets::iterator itr = range.first; itr != range.second; ++itr){
+                                if (*itr->second == val){
+                                        return itr->second;
+                                }
+                        }
+                        SharedResourceSet ret = std::make_shared<const FlatResourceSet>(val);
+                        sets.insert(std::make_pair(key, ret));
+                        return ret;
+                }
+
+                /**
+                 * @brief Gets the number of distinct sets in the pool.
+                 * @return Number of sets
+                 */
+                size_t size() const {return sets.size();}
+
+                /**
+                 * @brief Drops the sets no longer referenced outside the pool.
+                 * @return Number of sets dropped
+                 */
+                size_t purge()
+                {
+                        size_t removed = 0;
+                        for (Sets::iterator itr = sets.begin(); itr != sets.end();){
+                                if (itr->second.use_count() == 1){
+                                        itr = sets.erase(itr);
+                                        ++removed;
+                                } else {
+                                        ++itr;
+                                }
+                        }
+                        return removed;
+                }
+
+                /**
+                 * @brief Drops all sets. Instances still referenced stay valid.
+                 */
+                void clear() {sets.clear();}
+
+        protected:
+                typedef std::unordered_multimap<uint64_t, SharedResourceSet> Sets;
+                Sets sets;
+
+        private:
+                WIRECC_DISABLE_COPY_AND_ASSIGN(ResourceSetPool);
+        };
+
+        inline void ByteView::readRset(ResourceSetPool& pool, SharedResourceSet& val)
+        {
+                uint32_t size;
+                readUint(size);
+                FlatResourceSet ids(size);
+                for (uint32_t i=0; i < size; ++i){
+                        readInt(ids[i]);
+                }
+                val = pool.intern(ids);
+        }
+
+        /**
+         * @brief An immutable, reference-counted byte buffer.
+         * @details Obtained with ByteBuffer::freeze(). Copies share the same bytes
+         *          through an atomic reference count, so a single encoded message
+         *          can be handed to many send queues without copying it. The bytes
+         *          are released when the last copy is destroyed.
+         */
+        class SharedBuffer
+        {
+        public:
+                /**
+                 * @brief Constructs an empty shared buffer.
+                 */
+                SharedBuffer() {}
+
+                /**
+                 * @brief Takes ownership of the contents of a byte vector.
+                 * @param from The vector to take the bytes from, left empty
+                 */
+                explicit SharedBuffer(std::vector<uint8_t>& from)
+                {
+                        std::shared_ptr<std::vector<uint8_t> > tmp = std::make_shared<std::vector<uint8_t> >();
+                        tmp->swap(from);
+                        bytes = tmp;
+                }
+
+                /**
+                 * @brief Gets a pointer to the shared data.
+                 * @return Const pointer to the first byte, NULL if empty
+                 */
+                const uint8_t * data() const {return (bytes ? bytes->data() : NULL);}
+                /**
+                 * @brief Gets the size of the shared data.
+                 * @return Size in bytes
+                 */
+                unsigned int size() const {return (bytes ? bytes->size() : 0);}
+                /**
+                 * @brief Gets a read-only view over the shared data.
+                 * @return View valid for as long as any copy of this buffer exists
+                 */
+                ByteView view() const {return ByteView(data(), size());}
+                /**
+                 * @brief Gets the number of buffers sharing the data.
+                 * @return Reference count, 0 if empty
+                 */
+                long useCount() const {return bytes.use_count();}
+
+        protected:
+                std::shared_ptr<const std::vector<uint8_t> > bytes;
+        };
+
+        /**
+         * @brief Gets the position of a set bit within a word.
+         * @param word The word to search
+         * @param rank Zero-based rank of the set bit (must be < number of set bits)
+         * @return Bit position, 0 being the least significant bit
+         */
+        inline unsigned int selectInWord(uint64_t word, unsigned int rank)
+        {
+#if defined(__BMI2__)
+                return __builtin_ctzll(_pdep_u64((uint64_t) 1 << rank, word));
+#else
+                while (rank-- > 0){
+                        word &= word - 1;
+                }
+                return __builtin_ctzll(word);
+#endif
+        }
+
+        /**
+         * @brief A compressed, immutable ResourceSet using Elias-Fano encoding.
+         * @details Ids are stored relative to the smallest one, split into l low bits
+         *          packed in an array and high bits stored in unary in a bit vector,
+         *          for about 2 + log2(universe / size) bits per id. Samples of every
+         *          256th one and zero in the high bits give O(1) access to the i-th id
+         *          and fast successor queries without decoding the set.
+         */
+        class EliasFanoSet
+        {
+        public:
+                /**
+                 * @brief Constructs an empty set.
+                 */
+                EliasFanoSet() : count(0), base(0), lowBits(0) {}
+
+                /**
+                 * @brief Constructs a set holding the ids of a ResourceSet.
+                 * @param val The ids to encode
+                 */
+                explicit EliasFanoSet(const ResourceSet& val) {build(val);}
+
+                /**
+                 * @brief Replaces the contents with the ids of a ResourceSet.
+                 * @param val The ids to encode
+                 */
+                void build(const ResourceSet& val)
+                {
+                        count = val.size();
+                        base = (count > 0 ? *val.begin() : 0);
+                        lowBits = 0;
+                        uint64_t universe = (count > 0 ? (uint64_t) ((int64_t) *val.rbegin() - base) + 1 : 0);
+                        while (count > 0 && ((uint64_t) count << (lowBits + 1)) <= universe){
+                                ++lowBits;
+                        }
+                        lower.assign(((uint64_t) count * lowBits + 63) / 64, 0);
+                        upper.assign((count + (count > 0 ? (universe - 1) >> lowBits : 0) + 64) / 64, 0);
+                        uint64_t i = 0;
+                        for (ResourceSet::const_iterator itr = val.begin(); itr != val.end(); ++itr, ++i){
+                                uint64_t d = (uint64_t) ((int64_t) *itr - base);
+                                setLow(i, d);
+                                uint64_t h = (d >> lowBits) + i;
+                                upper[h / 64] |= (uint64_t) 1 << (h % 64);
+                        }
+                        index();
+                }
+
+                /**
+                 * @brief Gets the number of ids in the set.
+                 * @return Id count
+                 */
+                unsigned int size() const {return count;}
+
+                /**
+                 * @brief Gets the id at a position in ascending order.
+                 * @param i Position of the id (must be < size())
+                 * @return The id
+                 */
+                ResourceId at(unsigned int i) const
+                {
+                        WIRECC_ASSERT(i < count);
+                        return (ResourceId) (base + (int64_t) (((select(upper, ones, i, false) - i) << lowBits) | low(i)));
+                }
+
+                /**
+                 * @brief Finds the first id not less than a given one.
+                 * @param rid The id to search for
+                 * @return Position of the id, or size() if every id is less than rid
+                 */
+                unsigned int lowerBound(ResourceId rid) const
+                {
+                        if (count == 0 || rid <= base){
+                                return 0;
+                        }
+                        uint64_t d = (uint64_t) ((int64_t) rid - base);
+                        uint64_t h = d >> lowBits;
+                        uint64_t p = 0;
+                        if (h > 0){
+                                if (h > upper.size() * 64 - count){
+                                        return count;
+                                }
+                                p = select(upper, zeros, h - 1, true) + 1;
+                        }
+                        uint64_t i = p - h;
+                        uint64_t lo = d & lowMask();
+                        for (; i < count; ++p, ++i){
+                                if (((upper[p / 64] >> (p % 64)) & 1) == 0 || low(i) >= lo){
+                                        return i;
+                                }
+                        }
+                        return count;
+                }
+
+                /**
+                 * @brief Checks if an id is in the set.
+                 * @param rid The id to look up
+                 * @return true if found, false otherwise
+                 */
+                bool contains(ResourceId rid) const
+                {
+                        unsigned int i = lowerBound(rid);
+                        return (i < count && at(i) == rid);
+                }
+
+        protected:
+                friend class ByteBuffer;
+
+                uint64_t lowMask() const
+                {
+                        return ((uint64_t) 1 << lowBits) - 1;
+                }
+
+                uint64_t low(uint64_t i) const
+                {
+                        if (lowBits == 0){
+                                return 0;
+                        }
+                        uint64_t bit = i * lowBits;
+                        uint64_t val = lower[bit / 64] >> (bit % 64);
+                        if (bit % 64 + lowBits > 64){
+                                val |= lower[bit / 64 + 1] << (64 - bit % 64);
+                        }
+                        return val & lowMask();
+                }
+
+                void setLow(uint64_t i, uint64_t val)
+                {
+                        if (lowBits == 0){
+                                return;
+                        }
+                        val &= lowMask();
+                        uint64_t bit = i * lowBits;
+                        lower[bit / 64] |= val << (bit % 64);
+                        if (bit % 64 + lowBits > 64){
+                                lower[bit / 64 + 1] |= val >> (64 - bit % 64);
+                        }
+                }
+
+                // Samples the position of every 256th one and zero of the high bits
+                void index()
+                {
+                        ones.clear();
+                        zeros.clear();
+                        uint64_t seenOnes = 0, seenZeros = 0;
+                        for (unsigned int w=0; w < upper.size(); ++w){
+                                unsigned int pc = __builtin_popcountll(upper[w]);
+                                while (ones.size() * 256 < seenOnes + pc){
+                                        ones.push_back(w * 64 + selectInWord(upper[w], ones.size() * 256 - seenOnes));
+                                }
+                                while (zeros.size() * 256 < seenZeros + 64 - pc){
+                                        zeros.push_back(w * 64 + selectInWord(~upper[w], zeros.size() * 256 - seenZeros));
+                                }
+                                seenOnes += pc;
+                                seenZeros += 64 - pc;
+                        }
+                }
+
+                static uint64_t select(const std::vector<uint64_t>& bits, const std::vector<uint64_t>& samples,
+                                       uint64_t rank, bool zero)
+                {
+                        uint64_t from = samples[rank / 256];
+                        rank %= 256;
+                        uint64_t w = from / 64;
+                        uint64_t word = (zero ? ~bits[w] : bits[w]) & (~(uint64_t) 0 << (from % 64));
+                        for (;;){
+                                unsigned int pc = __builtin_popcountll(word);
+                                if (rank < pc){
+                                        return w * 64 + selectInWord(word, rank);
+                                }
+                                rank -= pc;
+                                ++w;
+                                word = (zero ? ~bits[w] : bits[w]);
+                        }
+                }
+
+                std::vector<uint64_t> lower, upper, ones, zeros;
+                unsigned int count;
+                ResourceId base;
+                unsigned int lowBits;
+        };
+
+        /**
+         * @brief A blocked Bloom filter over ResourceIds.
+         * @details Split-block design: an id sets one bit in each of the eight
+         *          32-bit words of a single 32-byte block, so a probe touches one
+         *          cache line and is answered with a few vector instructions. The
+         *          number of blocks is chosen from the expected number of ids and
+         *          the wanted false-positive rate.
+         */
+        class BloomFilter
+        {
+        public:
+                /**
+                 * @brief Constructs an empty filter that contains nothing.
+                 * @details Has no blocks, so insert() is ignored until init().
+                 */
+                BloomFilter() {}
+
+                /**
+                 * @brief Constructs a filter sized for a false-positive rate.
+                 * @param expected Expected number of ids
+                 * @param fpr Wanted false-positive rate, between 0 and 1
+                 */
+                BloomFilter(size_t expected, double fpr) {init(expected, fpr);}
+
+                /**
+                 * @brief Clears and resizes the filter for a false-positive rate.
+                 * @param expected Expected number of ids
+                 * @param fpr Wanted false-positive rate, between 0 and 1
+                 */
+                void init(size_t expected, double fpr)
+                {
+                        WIRECC_ASSERT(fpr > 0 && fpr < 1);
+                        // Start from the size of an unblocked filter with 8 hashes
+                        size_t blocks = (size_t) std::ceil(-8.0 * expected / std::log(1 - std::pow(fpr, 1 / 8.0)) / 256);
+                        blocks = std::max<size_t>(blocks, 1);
+                        while (estimateFpr(expected, blocks) > fpr){
+                                blocks += blocks / 16 + 1;
+                        }
+                        words.assign(blocks * 8, 0);
+                }
+
+                /**
+                 * @brief Estimates the false-positive rate of a filter.
+                 * @param count Number of ids in the filter
+                 * @param blocks Number of blocks of the filter
+                 * @return The expected false-positive rate
+                 * @details Averages the rate of a single block over the Poisson
+                 *          distribution of ids per block.
+                 */
+                static double estimateFpr(size_t count, size_t blocks)
+                {
+                        double lambda = (double) count / blocks;
+                        double ret = 0, p = std::exp(-lambda);
+                        size_t last = (size_t) (lambda + 10 * std::sqrt(lambda) + 20);
+                        for (size_t j=0; j <= last; ++j){
+                                ret += p * std::pow(1 - std::pow(1 - 1 / 32.0, (double) j), 8);
+                                p *= lambda / (j + 1);
+                        }
+                        return ret;
+                }
+
+                /**
+                 * @brief Adds an id.
+                 * @param rid The id to add, ignored if the filter has no blocks
+                 */
+                void insert(ResourceId rid)
+                {
+                        if (words.empty()){
+                                return;
+                        }
+                        uint64_t h = hashId(rid);
+                        uint32_t * block = &words[blockOf(h)];
+#if defined(__AVX2__)
+                        __m256i bits = _mm256_loadu_si256((const __m256i *) block);
+                        _mm256_storeu_si256((__m256i *) block, _mm256_or_si256(bits, mask((uint32_t) h)));
+#else
+                        for (unsigned int i=0; i < 8; ++i){
+                                block[i] |= (uint32_t) 1 << (((uint32_t) h * salts()[i]) >> 27);
+                        }
+#endif
+                }
+
+                /**
+                 * @brief Adds the ids of a container.
+                 * @tparam T Container of ResourceIds, e.g. ResourceSet or FlatResourceSet
+                 * @param ids The ids to add
+                 */
+                template<typename T>
+                void insertAll(const T& ids)
+                {
+                        for (Iterator<T> itr(ids); itr.current != itr.end; ++itr.current){
+                                insert(*itr.current);
+                        }
+                }
+
+                /**
+                 * @brief Checks whether an id may have been added.
+                 * @param rid The id to look up
+                 * @return false if the id was never added, true if it probably was
+                 */
+                bool contains(ResourceId rid) const
+                {
+                        if (words.empty()){
+                                return false;
+                        }
+                        uint64_t h = hashId(rid);
+                        const uint32_t * block = &words[blockOf(h)];
+#if defined(__AVX2__)
+                        __m256i bits = _mm256_loadu_si256((const __m256i *) block);
+                        return _mm256_testc_si256(bits, mask((uint32_t) h));
+#else
+                        for (unsigned int i=0; i < 8; ++i){
+                                if (!(block[i] & ((uint32_t) 1 << (((uint32_t) h * salts()[i]) >> 27)))){
+                                        return false;
+                                }
+                        }
+                        return true;
+#endif
+                }
+
+                /**
+                 * @brief Checks whether any id of a container may have been added.
+                 * @tparam T Container of ResourceIds, e.g. ResourceSet or FlatResourceSet
+                 * @param ids The ids to look up
+                 * @return false if none of the ids was added, true otherwise
+                 */
+                template<typename T>
+                bool containsAny(const T& ids) const
+                {
+                        for (Iterator<T> itr(ids); itr.current != itr.end; ++itr.current){
+                                if (contains(*itr.current)){
+                                        return true;
+                                }
+                        }
+                        return false;
+                }
+
+                /**
+                 * @brief Adds all ids of another filter.
+                 * @param other Filter with the same number of blocks
+                 * @return true if merged, false if the sizes differ
+                 */
+                bool merge(const BloomFilter& other)
+                {
+                        if (other.words.size() != words.size()){
+                                return false;
+                        }
+                        for (size_t i=0; i < words.size(); ++i){
+                                words[i] |= other.words[i];
+                        }
+                        return true;
+                }
+
+                /**
+                 * @brief Removes all ids, keeping the size.
+                 */
+                void clear() {std::fill(words.begin(), words.end(), 0);}
+
+                /**
+                 * @brief Gets the number of 32-byte blocks.
+                 * @return Number of blocks
+                 */
+                size_t blockCount() const {return words.size() / 8;}
+
+        protected:
+                friend class ByteBuffer;
+
+                static const uint32_t * salts()
+                {
+                        static const uint32_t vals[8] = {0x47b6137b, 0x44974d91, 0x8824ad5b, 0xa2b7289d,
+                                                         0x705495c7, 0x2df1424b, 0x9efc4947, 0x5c6bfb31};
+                        return vals;
+                }
+
+                size_t blockOf(uint64_t h) const
+                {
+                        return (size_t) (((h >> 32) * (words.size() / 8)) >> 32) * 8;
+                }
+
+#if defined(__AVX2__)
+                static __m256i mask(uint32_t h)
+                {
+                        __m256i mul = _mm256_loadu_si256((const __m256i *) salts());
+                        __m256i shifts = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(h), mul), 27);
+                        return _mm256_sllv_epi32(_mm256_set1_epi32(1), shifts);
+                }
+#endif
+
+                std::vector<uint32_t> words;
+        };
+
+        /**
+         * @brief A HyperLogLog sketch estimating the number of distinct ResourceIds.
+         * @details Each id is hashed to one of 2^precision registers holding the
+         *          longest run of leading zeros seen, for a standard error of about
+         *          1.04 / sqrt(2^precision). Small sketches are kept sparse, as a
+         *          sorted list of the non-zero registers, and become dense when the
+         *          list would outgrow the register array. Merging dense sketches
+         *          takes the byte-wise maximum of their registers.
+         */
+        class HyperLogLog
+        {
+        public:
+                /**
+                 * @brief Constructs an empty sketch.
+                 * @param precision Number of index bits, between 4 and 18
+                 */
+                explicit HyperLogLog(unsigned int precision=14) : bits(precision)
+                {
+                        WIRECC_ASSERT(precision >= 4 && precision <= 18);
+                }
+
+                /**
+                 * @brief Adds an id.
+                 * @param rid The id to add
+                 */
+                void add(ResourceId rid)
+                {
+                        uint64_t h = hashId(rid);
+                        uint32_t idx = (uint32_t) (h >> (64 - bits));
+                        uint8_t rank = __builtin_clzll((h << bits) | ((uint64_t) 1 << (bits - 1))) + 1;
+                        if (!registers.empty()){
+                                registers[idx] = std::max(registers[idx], rank);
+                                return;
+                        }
+                        uint32_t entry = (idx << 8) | rank;
+                        std::vector<uint32_t>::iterator itr = std::lower_bound(sparse.begin(), sparse.end(), idx << 8);
+                        if (itr != sparse.end() && (*itr >> 8) == idx){
+                                *itr = std::max(*itr, entry);
+                                return;
+                        }
+                        sparse.insert(itr, entry);
+                        if (sparse.size() * sizeof(uint32_t) > registerCount()){
+                                toDense();
+                        }
+                }
+
+                /**
+                 * @brief Adds the ids of a container.
+                 * @tparam T Container of ResourceIds, e.g. ResourceSet or FlatResourceSet
+                 * @param ids The ids to add
+                 */
+                template<typename T>
+                void addAll(const T& ids)
+                {
+                        for (Iterator<T> itr(ids); itr.current != itr.end; ++itr.current){
+                                add(*itr.current);
+                        }
+                }
+
+                /**
+                 * @brief Estimates the number of distinct ids added.
+                 * @return The estimate
+                 * @details Uses linear counting while many registers are still zero.
+                 */
+                double estimate() const
+                {
+                        double m = registerCount();
+                        if (registers.empty()){
+                                return m * std::log(m / (m - sparse.size()));
+                        }
+                        double sum = 0;
+                        unsigned int zeros = 0;
+                        for (size_t i=0; i < registers.size(); ++i){
+                                sum += std::ldexp(1.0, -registers[i]);
+                                zeros += (registers[i] == 0);
+                        }
+                        double alpha = (m == 16 ? 0.673 : (m == 32 ? 0.697 : (m == 64 ? 0.709 : 0.7213 / (1 + 1.079 / m))));
+                        double ret = alpha * m * m / sum;
+                        if (ret <= 2.5 * m && zeros > 0){
+                                ret = m * std::log(m / zeros);
+                        }
+                        return ret;
+                }
+
+                /**
+                 * @brief Adds all ids of another sketch.
+                 * @param other Sketch with the same precision
+                 * @return true if merged, false if the precisions differ
+                 */
+                bool merge(const HyperLogLog& other)
+                {
+                        if (other.bits != bits){
+                                return false;
+                        }
+                        if (registers.empty() && other.registers.empty()){
+                                std::vector<uint32_t> tmp;
+                                tmp.reserve(sparse.size() + other.sparse.size());
+                                std::merge(sparse.begin(), sparse.end(), other.sparse.begin(), other.sparse.end(),
+                                           std::back_inserter(tmp));
+                                sparse.clear();
+                                for (size_t i=0; i < tmp.size(); ++i){
+                                        if (!sparse.empty() && (sparse.back() >> 8) == (tmp[i] >> 8)){
+                                                sparse.back() = std::max(sparse.back(), tmp[i]);
+                                        } else {
+                                                sparse.push_back(tmp[i]);
+                                        }
+                                }
+                                if (sparse.size() * sizeof(uint32_t) > registerCount()){
+                                        toDense();
+                                }
+                                return true;
+                        }
+                        toDense();
+                        if (other.registers.empty()){
+                                for (size_t i=0; i < other.sparse.size(); ++i){
+                                        uint8_t& reg = registers[other.sparse[i] >> 8];
+                                        reg = std::max(reg, (uint8_t) other.sparse[i]);
+                                }
+                                return true;
+                        }
+                        size_t i = 0;
+#if defined(__SSE2__)
+                        for (; i + 16 <= registers.size(); i += 16){
+                                __m128i a = _mm_loadu_si128((const __m128i *) &registers[i]);
+                                __m128i b = _mm_loadu_si128((const __m128i *) &other.registers[i]);
+                                _mm_storeu_si128((__m128i *) &registers[i], _mm_max_epu8(a, b));
+                        }
+#endif
+                        for (; i < registers.size(); ++i){
+                                registers[i] = std::max(registers[i], other.registers[i]);
+                        }
+                        return true;
+                }
+
+                /**
+                 * @brief Removes all ids, going back to sparse mode.
+                 */
+                void clear()
+                {
+                        sparse.clear();
+                        registers.clear();
+                }
+
+                /**
+                 * @brief Gets the precision of the sketch.
+                 * @return Number of index bits
+                 */
+                unsigned int precision() const {return bits;}
+                /**
+                 * @brief Checks whether the sketch is in sparse mode.
+                 * @return true if sparse, false if dense
+                 */
+                bool isSparse() const {return registers.empty();}
+
+        protected:
+                friend class ByteBuffer;
+
+                size_t registerCount() const {return (size_t) 1 << bits;}
+
+                void toDense()
+                {
+                        if (!registers.empty()){
+                                return;
+                        }
+                        registers.assign(registerCount(), 0);
+                        for (size_t i=0; i < sparse.size(); ++i){
+                                registers[sparse[i] >> 8] = (uint8_t) sparse[i];
+                        }
+                        std::vector<uint32_t>().swap(sparse);
+                }
+
+                unsigned int bits;
+                std::vector<uint32_t> sparse;
+                std::vector<uint8_t> registers;
+        };
+
+        /**
+         * @brief A count-min sketch estimating how often each ResourceId was seen.
+         * @details Counts live in depth rows of width counters, a fixed amount of
+         *          memory however many ids are seen. Row indices are derived from one
+         *          id hash as h1 + i * h2 and computed for all rows at once. Updates
+         *          are conservative: only counters below the new estimate are raised,
+         *          which keeps overestimation low. A bounded list of the ids with the
+         *          highest estimates is kept for heavy-hitter queries.
+         */
+        class CountMinSketch
+        {
+        public:
+                typedef std::vector<std::pair<ResourceId, uint32_t> > Counts;
+
+                /**
+                 * @brief Constructs an empty sketch.
+                 * @param depth Number of rows, between 1 and 8
+                 * @param width Counters per row, rounded up to a power of two
+                 * @param topCount Number of heavy-hitter candidates kept
+                 * @details Estimates exceed the true count by at most e / width of the
+                 *          total with probability 1 - e^-depth.
+                 */
+                CountMinSketch(unsigned int depth=4, unsigned int width=1024, unsigned int topCount=16)
+                        : depth(depth), mask(1), topCount(topCount), total(0)
+                {
+                        WIRECC_ASSERT(depth >= 1 && depth <= 8);
+                        while (mask < width){
+                                mask <<= 1;
+                        }
+                        counters.assign((size_t) depth * mask, 0);
+                        --mask;
+                }
+
+                /**
+                 * @brief Counts occurrences of an id.
+                 * @param rid The id seen
+                 * @param count Number of occurrences
+                 * @return The new estimate for the id
+                 */
+                uint32_t add(ResourceId rid, uint32_t count=1)
+                {
+                        uint32_t idx[8];
+                        indices(rid, idx);
+                        uint32_t est = UINT32_MAX;
+                        for (unsigned int i=0; i < depth; ++i){
+                                est = std::min(est, counters[idx[i]]);
+                        }
+                        est = (est > UINT32_MAX - count ? UINT32_MAX : est + count);
+                        for (unsigned int i=0; i < depth; ++i){
+                                counters[idx[i]] = std::max(counters[idx[i]], est);
+                        }
+                        total += count;
+                        track(rid, est);
+                        return est;
+                }
+
+                /**
+                 * @brief Estimates how often an id was seen.
+                 * @param rid The id to look up
+                 * @return The estimate, never below the true count
+                 */
+                uint32_t estimate(ResourceId rid) const
+                {
+                        uint32_t idx[8];
+                        indices(rid, idx);
+                        uint32_t est = UINT32_MAX;
+                        for (unsigned int i=0; i < depth; ++i){
+                                est = std::min(est, counters[idx[i]]);
+                        }
+                        return est;
+                }
+
+                /**
+                 * @brief Gets the ids seen most often.
+                 * @param minCount Smallest estimate to report
+                 * @return Candidates with their estimates, highest first
+                 */
+                Counts heavyHitters(uint32_t minCount=0) const
+                {
+                        Counts ret;
+                        for (size_t i=0; i < top.size(); ++i){
+                                uint32_t est = estimate(top[i].first);
+                                if (est >= minCount){
+                                        ret.push_back(std::make_pair(top[i].first, est));
+                                }
+                        }
+                        std::sort(ret.begin(), ret.end(), [](const Counts::value_type& a, const Counts::value_type& b) {
+                                return (a.second != b.second ? a.second > b.second : a.first < b.first);
+                        });
+                        return ret;
+                }
+
+                /**
+                 * @brief Adds the counts of another sketch.
+                 * @param other Sketch with the same depth and width
+                 * @return true if merged, false if the dimensions differ
+                 */
+                bool merge(const CountMinSketch& other)
+                {
+                        if (other.depth != depth || other.mask != mask){
+                                return false;
+                        }
+                        for (size_t i=0; i < counters.size(); ++i){
+                                uint32_t sum = counters[i] + other.counters[i];
+                                counters[i] = (sum < counters[i] ? UINT32_MAX : sum);
+                        }
+                        total += other.total;
+                        for (size_t i=0; i < top.size(); ++i){
+                                top[i].second = estimate(top[i].first);
+                        }
+                        for (size_t i=0; i < other.top.size(); ++i){
+                                track(other.top[i].first, estimate(other.top[i].first));
+                        }
+                        return true;
+                }
+
+                /**
+                 * @brief Resets all counts.
+                 */
+                void clear()
+                {
+                        std::fill(counters.begin(), counters.end(), 0);
+                        top.clear();
+                        total = 0;
+                }
+
+                /**
+                 * @brief Gets the total of all counts added.
+                 * @return Sum of the counts
+                 */
+                uint64_t totalCount() const {return total;}
+
+        protected:
+                friend class ByteBuffer;
+
+                void indices(ResourceId rid, uint32_t * idx) const
+                {
+                        uint64_t h = hashId(rid);
+                        uint32_t h1 = (uint32_t) h;
+                        uint32_t h2 = (uint32_t) (h >> 32) | 1;
+#if defined(__AVX2__)
+                        __m256i rows = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+                        __m256i vals = _mm256_add_epi32(_mm256_set1_epi32(h1), _mm256_mullo_epi32(_mm256_set1_epi32(h2), rows));
+                        vals = _mm256_and_si256(vals, _mm256_set1_epi32(mask));
+                        vals = _mm256_add_epi32(vals, _mm256_mullo_epi32(rows, _mm256_set1_epi32(mask + 1)));
+                        _mm256_storeu_si256((__m256i *) idx, vals);
+#else
+                        for (unsigned int i=0; i < 8; ++i){
+                                idx[i] = ((h1 + i * h2) & mask) + i * (mask + 1);
+                        }
+#endif
+                }
+
+                void track(ResourceId rid, uint32_t est)
+                {
+                        size_t lowest = 0;
+                        for (size_t i=0; i < top.size(); ++i){
+                                if (top[i].first == rid){
+                                        top[i].second = est;
+                                        return;
+                                }
+                                if (top[i].second < top[lowest].second){
+                                        lowest = i;
+                                }
+                        }
+                        if (top.size() < topCount){
+                                top.push_back(std::make_pair(rid, est));
+                        } else if (topCount > 0 && est > top[lowest].second){
+                                top[lowest] = std::make_pair(rid, est);
+                        }
+                }
+
+                unsigned int depth, mask, topCount;
+                uint64_t total;
+                std::vector<uint32_t> counters;
+                Counts top;
+        };
+
+        /**
+         * @brief A byte buffer for reading and writing binary data.
+         * @details Provides methods for serializing and deserializing various data types
+         *          in big-endian format. Must call load() or clear() before use.
+         * @warning Mixing byte reads and writes is not supported.
+         * @warning Assumes two's complement representation for signed numbers.
+         */
+        class ByteBuffer
+        {
+        public:
+                /**
+                 * @brief Default constructor that clears the buffer.
+                 */
+                ByteBuffer() {clear();}
+
+                /**
+                 * @brief Reads a ByteBuffer from the current position.
+                 * @param buffer The buffer to store the read data
+                 */
+                void readBuffer(ByteBuffer& buffer)
+                {
+                        unsigned int size;
+                        readUint(size);
+                        buffer.load(&buf[pos], size);
+                        pos += size;
+                }
+
+                /**
+                 * @brief Reads a ByteBuffer from the current position as a view, without copying it.
+                 * @param view The view to point at the nested buffer
+                 */
+                void readBuffer(ByteView& view)
+                {
+                        unsigned int size;
+                        readUint(size);
+                        view = ByteView(buf.data() + pos, size);
+                        pos += size;
+                }
+
+                /**
+                 * @brief Reads a bit stream written by writeBits(), without copying it.
+                 * @param reader The reader to point at the stream
+                 */
+                void readBits(BitReader& reader)
+                {
+                        unsigned int size;
+                        readUint(size);
+                        reader = BitReader(buf.data() + pos, size);
+                        pos += size;
+                }
+
+                /**
+                 * @brief Writes a bit stream, such as packed flags or sub-byte fields.
+                 * @param bits The stream to write
+                 * @details Encoded like a nested buffer, the last byte padded with zeros.
+                 */
+                void writeBits(const BitWriter& bits)
+                {
+                        writeUint(bits.size());
+                        buf.resize(buf.size() + bits.size());
+                        pos += bits.copy(buf.data() + pos);
+                }
+
+                /**
+                 * @brief Writes a ByteBuffer to the current position.
+                 * @param b The buffer to write
+                 */
+                void writeBuffer(const ByteBuffer& b)
+                {
+                        writeUint(b.size());
+                        buf.insert(buf.end(), b.data(), b.data()+b.size());
+                        pos += b.size();
+                }
+
+                /**
+                 * @brief Skips a ByteBuffer at the current position without copying it.
+                 */
+                void skipBuffer()
+                {
+                        unsigned int size;
+                        readUint(size);
+                        pos += size;
+                }
+
+                /**
+                 * @brief Reads a 64-bit unsigned integer from the buffer.
+                 * @param val Reference to store the read value
+                 */
+                void readU64(uint64_t& val)
+                {
+                        val = be64decode(&buf[pos]);
+                        pos += sizeof(uint64_t);
+                }
+
+                /**
+                 * @brief Writes a 64-bit unsigned integer to the buffer.
+                 * @param val The value to write
+                 */
+                void writeU64(uint64_t val)
+                {
+                        buf.resize(buf.size() + sizeof(uint64_t));
+                        be64encode(val, &buf[pos]);
+                        pos += sizeof(uint64_t);
+                }
+
+                /**
+                 * @brief Skips a 64-bit unsigned integer.
+                 */
+                void skipU64() {pos += sizeof(uint64_t);}
+
+                /**
+                 * @brief Reads a double from the buffer.
+                 * @param val Reference to store the read value
+                 */
+                void readDouble(double& val)
+                {
+                        uint64_t bits;
+                        readU64(bits);
+                        memcpy(&val, &bits, sizeof(val));
+                }
+
+                /**
+                 * @brief Writes a double to the buffer, as its IEEE 754 bits.
+                 * @param val The value to write
+                 */
+                void writeDouble(double val)
+                {
+                        uint64_t bits;
+                        memcpy(&bits, &val, sizeof(bits));
+                        writeU64(bits);
+                }
+
+                /**
+                 * @brief Reads an unsigned integer from the buffer.
+                 * @param val Reference to store the read value
+                 */
+                void readUint(unsigned int& val)
+                {
+                        val = be32decode(&buf[pos]);
+                        pos += sizeof(uint32_t);
+                }
+
+                /**
+                 * @brief Writes an unsigned integer to the buffer.
+                 * @param val The value to write
+                 */
+                void writeUint(unsigned int val)
+                {
+                        buf.resize(buf.size() + sizeof(uint32_t));
+                        be32encode(val, &buf[pos]);
+                        pos += sizeof(uint32_t);
+                }
+
+                /**
+                 * @brief Skips an unsigned integer.
+                 */
+                void skipUint() {pos += sizeof(uint32_t);}
+
+                /**
+                 * @brief Overwrites an unsigned integer already in the buffer.
+                 * @param at Position of the value to overwrite
+                 * @param val The value to write
+                 * @details The current position is left unchanged.
+                 */
+                void writeUintAt(unsigned int at, unsigned int val)
+                {
+                        WIRECC_ASSERT(at + sizeof(uint32_t) <= buf.size());
+                        be32encode(val, &buf[at]);
+                }
+
+                /**
+                 * @brief Reads a signed integer from the buffer.
+                 * @param val Reference to store the read value
+                 */
+                void readInt(int& val)
+                {
+                        unsigned int tmp;
+                        readUint(tmp);
+                        val = tmp;
+                }
+
+                /**
+                 * @brief Writes a signed integer to the buffer.
+                 * @param val The value to write
+                 */
+                void writeInt(int val)
+                {
+                        unsigned int tmp = val;
+                        writeUint(tmp);
+                }
+
+                /**
+                 * @brief Skips a signed integer.
+                 */
+                void skipInt() {skipUint();}
+
+                /**
+                 * @brief Reads a ResourceSet from the buffer.
+                 * @param val Reference to the ResourceSet to populate
+                 */
+                void readRset(ResourceSet& val)
+                {
+                        uint32_t size;
+                        readUint(size);
+                        while (size-- > 0){
+                                ResourceId r;
+                                readInt(r);
+                                val.insert(r);
+                        }
+                }
+
+                /**
+                 * @brief Writes a ResourceSet to the buffer.
+                 * @param val The ResourceSet to write
+                 */
+                void writeRset(const ResourceSet& val)
+                {
+                        uint32_t size = val.size();
+                        writeUint(size);
+                        for (ResourceIterator itr = ResourceIterator(val);
+                             itr.current != itr.end; ++itr.current) {
+                                writeInt(*itr.current);
+                        }
+                }
+
+                /**
+                 * @brief Writes a flat set to the buffer, in the same format as a ResourceSet.
+                 * @param val The ids to write, sorted and without duplicates
+                 */
+                void writeRset(const FlatResourceSet& val)
+                {
+                        writeUint((uint32_t) val.size());
+                        for (FlatResourceIterator itr = FlatResourceIterator(val);
+                             itr.current != itr.end; ++itr.current) {
+                                writeInt(*itr.current);
+                        }
+                }
+
+                /**
+                 * @brief Writes a persistent set to the buffer, in the same format as a ResourceSet.
+                 * @param val The set to write
+                 */
+                void writeRset(const PersistentResourceSet& val)
+                {
+                        writeUint((uint32_t) val.size());
+                        for (PersistentResourceIterator itr = PersistentResourceIterator(val);
+                             itr.current != itr.end; ++itr.current) {
+                                writeInt(*itr.current);
+                        }
+                }
+
+                /**
+                 * @brief Reads a ResourceSet into a persistent set.
+                 * @param val Reference to the set to populate, its contents are replaced
+                 */
+                void readRset(PersistentResourceSet& val)
+                {
+                        ByteView in = view();
+                        in.setPos(pos);
+                        in.readRset(val);
+                        pos = in.getPos();
+                }
+
+                /**
+                 * @brief Reads a ResourceSet as an interned flat set.
+                 * @param pool Pool the set is interned in
+                 * @param val Receives the shared instance
+                 */
+                void readRset(ResourceSetPool& pool, SharedResourceSet& val)
+                {
+                        ByteView in = view();
+                        in.setPos(pos);
+                        in.readRset(pool, val);
+                        pos = in.getPos();
+                }
+
+                /**
+                 * @brief Skips a ResourceSet without building it.
+                 * @details Ids are fixed-width, so only the size prefix is read.
+                 */
+                void skipRset()
+                {
+                        uint32_t size;
+                        readUint(size);
+                        pos += size * sizeof(uint32_t);
+                }
+
+                /**
+                 * @brief Writes a ResourceSet in Elias-Fano encoding.
+                 * @param val The ResourceSet to write
+                 */
+                void writeEliasFano(const ResourceSet& val)
+                {
+                        writeEliasFano(EliasFanoSet(val));
+                }
+
+                /**
+                 * @brief Writes an Elias-Fano encoded set.
+                 * @param val The set to write
+                 */
+                void writeEliasFano(const EliasFanoSet& val)
+                {
+                        writeUint(val.count);
+                        writeInt(val.base);
+                        writeUint(val.lowBits);
+                        writeUint(val.lower.size());
+                        writeUint(val.upper.size());
+                        for (unsigned int i=0; i < val.lower.size(); ++i){
+                                writeU64(val.lower[i]);
+                        }
+                        for (unsigned int i=0; i < val.upper.size(); ++i){
+                                writeU64(val.upper[i]);
+                        }
+                }
+
+                /**
+                 * @brief Reads a set written by writeEliasFano(), without building a ResourceSet.
+                 * @param val The set to populate
+                 * @return true if the set is consistent, false otherwise (val is left
+                 *         unchanged and the rest of the set unread)
+                 * @details Ids span at most 2^32 values, so there are fewer than 32 low
+                 *          bits and the high bits fit in a bounded number of words. The
+                 *          low bit array must hold exactly count * lowBits bits and the
+                 *          high bits exactly count ones, as written by the encoder.
+                 */
+                bool readEliasFano(EliasFanoSet& val)
+                {
+                        unsigned int count, lowBits, lowerSize, upperSize;
+                        ResourceId base;
+                        if (pos > buf.size() || buf.size() - pos < 5 * sizeof(uint32_t)){
+                                return false;
+                        }
+                        readUint(count);
+                        readInt(base);
+                        readUint(lowBits);
+                        readUint(lowerSize);
+                        readUint(upperSize);
+                        if (lowBits > 31 || (count == 0 && lowBits != 0) || upperSize == 0 ||
+                            lowerSize != ((uint64_t) count * lowBits + 63) / 64 ||
+                            upperSize > ((uint64_t) count + (0xFFFFFFFFULL >> lowBits) + 64) / 64 ||
+                            ((uint64_t) lowerSize + upperSize) * sizeof(uint64_t) > buf.size() - pos){
+                                return false;
+                        }
+                        std::vector<uint64_t> lower(lowerSize), upper(upperSize);
+                        for (unsigned int i=0; i < lowerSize; ++i){
+                                readU64(lower[i]);
+                        }
+                        uint64_t ones = 0;
+                        for (unsigned int i=0; i < upperSize; ++i){
+                                readU64(upper[i]);
+                                ones += __builtin_popcountll(upper[i]);
+                        }
+                        if (ones != count){
+                                return false;
+                        }
+                        val.count = count;
+                        val.base = base;
+                        val.lowBits = lowBits;
+                        val.lower.swap(lower);
+                        val.upper.swap(upper);
+                        val.index();
+                        return true;
+                }
+
+                /**
+                 * @brief Writes a Bloom filter.
+                 * @param val The filter to write
+                 */
+                void writeBloom(const BloomFilter& val)
+                {
+                        writeUint(val.words.size() / 8);
+                        for (size_t i=0; i < val.words.size(); ++i){
+                                writeUint(val.words[i]);
+                        }
+                }
+
+                /**
+                 * @brief Reads a filter written by writeBloom().
+                 * @param val The filter to populate
+                 * @return true if the filter has at least one block, false otherwise
+                 *         (val is left unchanged)
+                 */
+                bool readBloom(BloomFilter& val)
+                {
+                        unsigned int blocks;
+                        readUint(blocks);
+                        if (blocks == 0){
+                                return false;
+                        }
+                        val.words.resize((size_t) blocks * 8);
+                        for (size_t i=0; i < val.words.size(); ++i){
+                                readUint(val.words[i]);
+                        }
+                        return true;
+                }
+
+                /**
+                 * @brief Writes a HyperLogLog sketch.
+                 * @param val The sketch to write
+                 * @details Sparse sketches are written as their non-zero registers.
+                 */
+                void writeHyperLogLog(const HyperLogLog& val)
+                {
+                        buf.push_back((uint8_t) val.bits);
+                        buf.push_back(val.isSparse() ? 0 : 1);
+                        pos += 2;
+                        if (val.isSparse()){
+                                writeUint(val.sparse.size());
+                                for (size_t i=0; i < val.sparse.size(); ++i){
+                                        writeUint(val.sparse[i]);
+                                }
+                        } else {
+                                concat(val.registers.data(), val.registers.size());
+                        }
+                }
+
+                /**
+                 * @brief Reads a sketch written by writeHyperLogLog().
+                 * @param val The sketch to populate
+                 * @return true if the sketch is valid, false otherwise (val is left
+                 *         unchanged and the rest of the sketch unread)
+                 * @details The precision must be between 4 and 18, registers must fit
+                 *          in the buffer and hold ranks possible at that precision, and
+                 *          sparse entries must have increasing indices below 2^precision.
+                 */
+                bool readHyperLogLog(HyperLogLog& val)
+                {
+                        if (pos > buf.size() || buf.size() - pos < 2){
+                                return false;
+                        }
+                        unsigned int bits = buf[pos];
+                        bool dense = (buf[pos + 1] != 0);
+                        if (bits < 4 || bits > 18){
+                                return false;
+                        }
+                        pos += 2;
+                        size_t count = (size_t) 1 << bits;
+                        unsigned int maxRank = 64 - bits + 1;
+                        if (dense){
+                                if (count > buf.size() - pos){
+                                        return false;
+                                }
+                                const uint8_t * regs = &buf[pos];
+                                for (size_t i=0; i < count; ++i){
+                                        if (regs[i] > maxRank){
+                                                return false;
+                                        }
+                                }
+                                val.sparse.clear();
+                                val.bits = bits;
+                                val.registers.assign(regs, regs + count);
+                                pos += count;
+                                return true;
+                        }
+                        unsigned int size;
+                        if (buf.size() - pos < sizeof(uint32_t)){
+                                return false;
+                        }
+                        readUint(size);
+                        // Larger sparse lists are written dense
+                        if (size > count / sizeof(uint32_t) || (size_t) size * sizeof(uint32_t) > buf.size() - pos){
+                                return false;
+                        }
+                        std::vector<uint32_t> sparse(size);
+                        for (unsigned int i=0; i < size; ++i){
+                                readUint(sparse[i]);
+                                uint32_t idx = sparse[i] >> 8, rank = sparse[i] & 0xff;
+                                if (idx >= count || rank == 0 || rank > maxRank || (i > 0 && idx <= (sparse[i - 1] >> 8))){
+                                        return false;
+                                }
+                        }
+                        val.registers.clear();
+                        val.bits = bits;
+                        val.sparse.swap(sparse);
+                        return true;
+                }
+
+                /**
+                 * @brief Writes a count-min sketch, with its heavy-hitter candidates.
+                 * @param val The sketch to write
+                 */
+                void writeCountMin(const CountMinSketch& val)
+                {
+                        writeUint(val.depth);
+                        writeUint(val.mask + 1);
+                        writeUint(val.topCount);
+                        writeU64(val.total);
+                        for (size_t i=0; i < val.counters.size(); ++i){
+                                writeUint(val.counters[i]);
+                        }
+                        writeUint(val.top.size());
+                        for (size_t i=0; i < val.top.size(); ++i){
+                                writeInt(val.top[i].first);
+                        }
+                }
+
+                /**
+                 * @brief Reads a sketch written by writeCountMin().
+                 * @param val The sketch to populate
+                 * @return true if the sketch dimensions are valid, false otherwise
+                 *         (val is left unchanged and the rest of the sketch unread)
+                 * @details Depth must be between 1 and 8 and width a power of two, the
+                 *          counters must fit in the buffer and there must be no more
+                 *          heavy-hitter candidates than the sketch keeps.
+                 */
+                bool readCountMin(CountMinSketch& val)
+                {
+                        unsigned int depth, width, topCount, count;
+                        uint64_t total;
+                        if (pos > buf.size() || buf.size() - pos < 3 * sizeof(uint32_t) + sizeof(uint64_t)){
+                                return false;
+                        }
+                        readUint(depth);
+                        readUint(width);
+                        if (depth < 1 || depth > 8 || width == 0 || (width & (width - 1)) != 0){
+                                return false;
+                        }
+                        readUint(topCount);
+                        readU64(total);
+                        // The counters are followed by at least the candidate count
+                        size_t size = (size_t) depth * width;
+                        if (size >= (buf.size() - pos) / sizeof(uint32_t)){
+                                return false;
+                        }
+                        std::vector<uint32_t> counters(size);
+                        for (size_t i=0; i < size; ++i){
+                                readUint(counters[i]);
+                        }
+                        readUint(count);
+                        if (count > topCount || count > (buf.size() - pos) / sizeof(uint32_t)){
+                                return false;
+                        }
+                        val.depth = depth;
+                        val.mask = width - 1;
+                        val.topCount = topCount;
+                        val.total = total;
+                        val.counters.swap(counters);
+                        val.top.resize(count);
+                        for (unsigned int i=0; i < count; ++i){
+                                readInt(val.top[i].first);
+                                val.top[i].second = val.estimate(val.top[i].first);
+                        }
+                        return true;
+                }
+
+                /**
+                 * @brief Reads a string from the buffer.
+                 * @param val Reference to the string to populate
+                 */
+                void readString(std::string& val)
+                {
+                        uint32_t size;
+                        readUint(size);
+                        while (size-- > 0){
+                                val.push_back(*(&buf[pos]));
+                                ++pos;
+                        }
+                }
+
+                /**
+                 * @brief Writes a string to the buffer.
+                 * @param val The string to write
+                 */
+                void writeString(const std::string& val)
+                {
+                        uint32_t size = val.size();
+                        writeUint(size);
+                        buf.resize(buf.size() + size);
+                        for (unsigned int i=0; i < size; ++i){
+                                *(&buf[pos]) = val[i];
+                                ++pos;
+                        }
+                }
+
+                /**
+                 * @brief Skips a string without allocating it.
+                 */
+                void skipString()
+                {
+                        uint32_t size;
+                        readUint(size);
+                        pos += size;
+                }
+
+                /**
+                 * @brief Reads a string, checking that it is valid UTF-8.
+                 * @param val Reference to the string to append to, unchanged on failure
+                 * @return true if the string is valid UTF-8, false otherwise
+                 * @details Validation is fused with the copy. The string is skipped either way.
+                 */
+                bool readUtf8String(std::string& val)
+                {
+                        ByteView in = view();
+                        in.setPos(pos);
+                        bool ok = in.readUtf8String(val);
+                        pos = in.getPos();
+                        return ok;
+                }
+
+                /**
+                 * @brief Writes a string against a per-stream StringTable.
+                 * @param val The string to write
+                 * @param table The encoding side table of the stream
+                 * @details Writes a varint header holding the id and a 2-bit kind,
+                 *          followed by the string for first uses.
+                 */
+                void writeString(const std::string& val, StringTable& table)
+                {
+                        unsigned int id;
+                        if (table.find(val, id)){
+                                writeVarint(((uint64_t) id << 2) | StringTable::STRING_REF);
+                                return;
+                        }
+                        if (table.add(val, id)){
+                                writeVarint(((uint64_t) id << 2) | StringTable::STRING_DEFINE);
+                        } else {
+                                writeVarint(StringTable::STRING_LITERAL);
+                        }
+                        writeVarint(val.size());
+                        concat((const uint8_t *) val.data(), val.size());
+                }
+
+                /**
+                 * @brief Reads a string written against a StringTable, without copying it.
+                 * @param val The view to point at the string bytes
+                 * @param table The decoding side table of the stream
+                 * @return true if the string was read, false otherwise
+                 * @see ByteView::readString(ByteView&, StringTable&)
+                 */
+                bool readString(ByteView& val, StringTable& table)
+                {
+                        ByteView in = view();
+                        in.setPos(pos);
+                        bool ok = in.readString(val, table);
+                        pos = in.getPos();
+                        return ok;
+                }
+
+                /**
+                 * @brief Reads a string written against a StringTable into a string.
+                 * @param val Reference to store the read string
+                 * @param table The decoding side table of the stream
+                 * @return true if the string was read, false otherwise
+                 */
+                bool readString(std::string& val, StringTable& table)
+                {
+                        ByteView in = view();
+                        in.setPos(pos);
+                        bool ok = in.readString(val, table);
+                        pos = in.getPos();
+                        return ok;
+                }
+
+                /**
+                 * @brief Writes a sorted list of strings using front coding.
+                 * @param vals The strings to write, in ascending order
+                 * @param restartInterval Number of entries between restart points
+                 * @details Each entry stores the length of the prefix it shares with the
+                 *          previous entry and the remaining suffix. Every restartInterval
+                 *          entries the full string is stored and its offset recorded in a
+                 *          table ahead of the data, so SortedStringsReader can binary
+                 *          search the list without decoding it.
+                 */
+                void writeSortedStrings(const std::vector<std::string>& vals, unsigned int restartInterval=16)
+                {
+                        WIRECC_ASSERT(restartInterval > 0);
+                        unsigned int count = vals.size();
+                        unsigned int restarts = (count + restartInterval - 1) / restartInterval;
+                        writeUint(count);
+                        writeUint(restartInterval);
+                        unsigned int table = pos;
+                        for (unsigned int i=0; i <= restarts; ++i){
+                                writeUint(0);
+                        }
+                        unsigned int base = pos;
+                        for (unsigned int i=0; i < count; ++i){
+                                const std::string& cur = vals[i];
+                                unsigned int shared = 0;
+                                if (i % restartInterval == 0){
+                                        writeUintAt(table + (i / restartInterval) * sizeof(uint32_t), pos - base);
+                                } else {
+                                        const std::string& prev = vals[i - 1];
+                                        WIRECC_ASSERT(prev <= cur);
+                                        unsigned int limit = std::min(prev.size(), cur.size());
+                                        while (shared < limit && prev[shared] == cur[shared]){
+                                                ++shared;
+                                        }
+                                }
+                                writeVarint(shared);
+                                writeVarint(cur.size() - shared);
+                                concat((const uint8_t *) cur.data() + shared, cur.size() - shared);
+                        }
+                        writeUintAt(table + restarts * sizeof(uint32_t), pos - base);
+                }
+
+                /**
+                 * @brief Reads a whole list written by writeSortedStrings().
+                 * @param vals Vector to append the strings to
+                 * @return true if the list is well formed, false otherwise (vals is
+                 *         left unchanged and the rest of the list unread)
+                 * @details The restart interval must be non-zero, and no entry may
+                 *          share more bytes than the previous entry has.
+                 */
+                bool readSortedStrings(std::vector<std::string>& vals)
+                {
+                        unsigned int count, interval;
+                        readUint(count);
+                        readUint(interval);
+                        if (interval == 0 || pos > buf.size()){
+                                return false;
+                        }
+                        unsigned int restarts = count / interval + (count % interval != 0);
+                        if (restarts >= (buf.size() - pos) / sizeof(uint32_t)){
+                                return false;
+                        }
+                        pos += (restarts + 1) * sizeof(uint32_t);
+                        size_t old = vals.size();
+                        std::string cur;
+                        for (unsigned int i=0; i < count; ++i){
+                                uint64_t shared, size;
+                                readVarint(shared);
+                                readVarint(size);
+                                if (shared > (i % interval != 0 ? cur.size() : 0) ||
+                                    pos > buf.size() || size > buf.size() - pos){
+                                        vals.resize(old);
+                                        return false;
+                                }
+                                cur.resize(shared);
+                                cur.append((const char *) buf.data() + pos, size);
+                                pos += size;
+                                vals.push_back(cur);
+                        }
+                        return true;
+                }
+
+                /**
+                 * @brief Writes unsigned integers using frame-of-reference bit packing.
+                 * @param vals The values to write
+                 * @details Values are split in blocks of 128. Each block stores its
+                 *          minimum as a varint and the bit width of the largest
+                 *          difference, followed by the differences packed with
+                 *          bitPackLanes(). Small-range arrays take a few bits per value.
+                 */
+                void writePackedUints(const std::vector<uint32_t>& vals) {writePacked(vals);}
+
+                /**
+                 * @brief Reads values written by writePackedUints().
+                 * @param vals Vector to append the values to
+                 */
+                void readPackedUints(std::vector<uint32_t>& vals) {readPacked(vals);}
+
+                /**
+                 * @brief Writes signed integers, such as ResourceIds, using frame-of-reference bit packing.
+                 * @param vals The values to write
+                 * @see writePackedUints()
+                 */
+                void writePackedInts(const std::vector<int>& vals) {writePacked(vals);}
+
+                /**
+                 * @brief Reads values written by writePackedInts().
+                 * @param vals Vector to append the values to
+                 */
+                void readPackedInts(std::vector<int>& vals) {readPacked(vals);}
+
+                /**
+                 * @brief Writes an array of doubles at a chosen precision.
+                 * @param vals The values to write, finite for the quantized precisions
+                 * @param precision The wire precision, lossy except for FLOAT_64
+                 * @details Quantized arrays store the minimum and maximum as doubles
+                 *          followed by codes spread evenly between them.
+                 */
+                void writeFloatArray(const std::vector<double>& vals, FloatPrecision precision)
+                {
+                        unsigned int count = vals.size();
+                        buf.push_back((uint8_t) precision);
+                        ++pos;
+                        writeUint(count);
+                        if (precision == QUANT_16 || precision == QUANT_8){
+                                double lo = (count > 0 ? *std::min_element(vals.begin(), vals.end()) : 0);
+                                double hi = (count > 0 ? *std::max_element(vals.begin(), vals.end()) : 0);
+                                writeDouble(lo);
+                                writeDouble(hi);
+                                double levels = (precision == QUANT_16 ? 65535.0 : 255.0);
+                                double scale = (hi > lo ? levels / (hi - lo) : 0);
+                                buf.resize(buf.size() + count * (precision == QUANT_16 ? 2 : 1));
+                                for (unsigned int i=0; i < count; ++i){
+                                        uint16_t code = (uint16_t) ((vals[i] - lo) * scale + 0.5);
+                                        if (precision == QUANT_16){
+                                                be16encode(code, &buf[pos]);
+                                                pos += 2;
+                                        } else {
+                                                buf[pos++] = (uint8_t) code;
+                                        }
+                                }
+                                return;
+                        }
+                        if (precision == FLOAT_16){
+                                std::vector<uint16_t> half(count);
+                                halfEncode(vals.data(), count, half.data());
+                                buf.resize(buf.size() + count * 2);
+                                for (unsigned int i=0; i < count; ++i){
+                                        be16encode(half[i], &buf[pos]);
+                                        pos += 2;
+                                }
+                                return;
+                        }
+                        for (unsigned int i=0; i < count; ++i){
+                                if (precision == FLOAT_64){
+                                        writeDouble(vals[i]);
+                                } else if (precision == FLOAT_32){
+                                        float f = (float) vals[i];
+                                        uint32_t bits;
+                                        memcpy(&bits, &f, sizeof(bits));
+                                        writeUint(bits);
+                                } else {
+                                        buf.resize(buf.size() + 2);
+                                        be16encode(floatToBfloat16((float) vals[i]), &buf[pos]);
+                                        pos += 2;
+                                }
+                        }
+                }
+
+                /**
+                 * @brief Reads an array written by writeFloatArray().
+                 * @param vals Vector to append the values to
+                 */
+                void readFloatArray(std::vector<double>& vals)
+                {
+                        FloatPrecision precision = (FloatPrecision) buf[pos++];
+                        unsigned int count;
+                        readUint(count);
+                        unsigned int first = vals.size();
+                        vals.resize(first + count);
+                        double * out = vals.data() + first;
+                        if (precision == QUANT_16 || precision == QUANT_8){
+                                double lo, hi;
+                                readDouble(lo);
+                                readDouble(hi);
+                                double step = (hi - lo) / (precision == QUANT_16 ? 65535.0 : 255.0);
+                                for (unsigned int i=0; i < count; ++i){
+                                        unsigned int code;
+                                        if (precision == QUANT_16){
+                                                code = be16decode(&buf[pos]);
+                                                pos += 2;
+                                        } else {
+                                                code = buf[pos++];
+                                        }
+                                        out[i] = lo + code * step;
+                                }
+                                return;
+                        }
+                        if (precision == FLOAT_16){
+                                std::vector<uint16_t> half(count);
+                                for (unsigned int i=0; i < count; ++i){
+                                        half[i] = be16decode(&buf[pos]);
+                                        pos += 2;
+                                }
+                                halfDecode(half.data(), count, out);
+                                return;
+                        }
+                        for (unsigned int i=0; i < count; ++i){
+                                if (precision == FLOAT_64){
+                                        readDouble(out[i]);
+                                } else if (precision == FLOAT_32){
+                                        unsigned int bits;
+                                        float f;
+                                        readUint(bits);
+                                        memcpy(&f, &bits, sizeof(f));
+                                        out[i] = f;
+                                } else {
+                                        out[i] = bfloat16ToFloat(be16decode(&buf[pos]));
+                                        pos += 2;
+                                }
+                        }
+                }
+
+                /**
+                 * @brief Writes a C-style string to the buffer.
+                 * @param val The null-terminated string to write
+                 */
+                void writeCstring(const char * val)
+                {
+                        writeString(std::string(val));
+                }
+
+                /**
+                 * @brief Reads a boolean value from the buffer.
+                 * @param val Reference to store the read boolean value
+                 */
+                void readBool(bool& val)
+                {
+                        val = (*(&buf[pos]) != 0);
+                        ++pos;
+                }
+
+                /**
+                 * @brief Writes a boolean value to the buffer.
+                 * @param val The boolean value to write
+                 */
+                void writeBool(bool val)
+                {
+                        buf.resize(buf.size() + 1);
+                        *(&buf[pos]) = (val ? 1 : 0);
+                        ++pos;
+                }
+
+                /**
+                 * @brief Skips a boolean value.
+                 */
+                void skipBool() {++pos;}
+
+                /**
+                 * @brief Reads a varint from the buffer.
+                 * @param val Reference to store the read value
+                 */
+                void readVarint(uint64_t& val)
+                {
+                        pos += varintDecode(buf.data() + pos, val);
+                }
+
+                /**
+                 * @brief Writes a varint to the buffer.
+                 * @param val The value to write
+                 */
+                void writeVarint(uint64_t val)
+                {
+                        buf.resize(buf.size() + varintSize(val));
+                        pos += varintEncode(val, &buf[pos]);
+                }
+
+                /**
+                 * @brief Skips a varint.
+                 */
+                void skipVarint() {pos += varintLength(buf.data() + pos);}
+
+                /**
+                 * @brief Starts a tagged field.
+                 * @param tag The field tag
+                 * @return Mark to pass to endTagged() once the value is written
+                 * @details Tagged fields are encoded as varint tag, varint value length
+                 *          and the value, so decoders can skip unknown tags without
+                 *          parsing them. The value is written with the regular write
+                 *          methods between beginTagged() and endTagged(). The length
+                 *          slot is reserved here as a 5-byte varint, padded with
+                 *          continuation bytes, and filled in by endTagged().
+                 */
+                unsigned int beginTagged(unsigned int tag)
+                {
+                        writeVarint(tag);
+                        unsigned int mark = pos;
+                        buf.resize(buf.size() + 5);
+                        pos += 5;
+                        return mark;
+                }
+
+                /**
+                 * @brief Ends a tagged field, writing its length in the reserved slot.
+                 * @param mark The value returned by beginTagged()
+                 */
+                void endTagged(unsigned int mark)
+                {
+                        WIRECC_ASSERT(mark + 5 <= pos);
+                        uint32_t size = pos - mark - 5;
+                        for (unsigned int i=0; i < 4; ++i){
+                                buf[mark + i] = (uint8_t) (size | 0x80);
+                                size >>= 7;
+                        }
+                        buf[mark + 4] = (uint8_t) size;
+                }
+
+                /**
+                 * @brief Writes a tagged field header for a value of known size.
+                 * @param tag The field tag
+                 * @param size Size of the value that follows, in bytes
+                 */
+                void writeTag(unsigned int tag, unsigned int size)
+                {
+                        writeVarint(tag);
+                        writeVarint(size);
+                }
+
+                /**
+                 * @brief Reads a tagged field header and its value, without copying it.
+                 * @param tag Reference to store the field tag
+                 * @param value The view to point at the field value
+                 */
+                void readTagged(unsigned int& tag, ByteView& value)
+                {
+                        uint64_t tmp, size;
+                        readVarint(tmp);
+                        readVarint(size);
+                        tag = tmp;
+                        value = ByteView(buf.data() + pos, size);
+                        pos += size;
+                }
+
+                /**
+                 * @brief Gets a pointer to the raw buffer data.
+                 * @return Const pointer to the internal buffer
+                 */
+                const uint8_t * data() const {return buf.data();}
+                /**
+                 * @brief Gets a read-only view over the whole buffer.
+                 * @return View starting at position 0, valid until the buffer is modified
+                 */
+                ByteView view() const {return ByteView(data(), size());}
+                /**
+                 * @brief Moves the contents into an immutable shared buffer.
+                 * @return Shared buffer holding the bytes, without copying them
+                 * @details The buffer is left cleared.
+                 */
+                SharedBuffer freeze()
+                {
+                        SharedBuffer ret(buf);
+                        clear();
+                        return ret;
+                }
+                /**
+                 * @brief Gets the size of the buffer.
+                 * @return Size of the buffer in bytes
+                 */
+                unsigned int size() const {return buf.size();}
+                /**
+                 * @brief Clears the buffer and resets position to 0.
+                 */
+                void clear() {buf.clear(); pos = 0;}
+                /**
+                 * @brief Sets the current position in the buffer.
+                 * @param newPos The new position to set
+                 */
+                void setPos(unsigned int newPos) {pos = newPos;}
+                /**
+                 * @brief Gets the current position in the buffer.
+                 * @return Current position in bytes
+                 */
+                unsigned int getPos() const {return pos;}
+                /**
+                 * @brief Loads data into the buffer, clearing any existing content.
+                 * @param data Pointer to the data to load
+                 * @param size Size of the data in bytes
+                 */
+                void load(const uint8_t * data, unsigned int size)
+                {
+                        clear();
+                        buf.insert(buf.begin(), data, data+size);
+                }
+
+                /**
+                 * @brief Dumps the buffer as lowercase hexadecimal.
+                 * @return The text, two chars per byte
+                 */
+                std::string toHex() const {return view().toHex();}
+
+                /**
+                 * @brief Encodes the buffer as base64.
+                 * @return The text, with padding
+                 */
+                std::string toBase64() const {return view().toBase64();}
+
+                /**
+                 * @brief Loads data parsed from hexadecimal text, clearing any existing content.
+                 * @param text The text, digits in either case
+                 * @return true if the text is valid, false otherwise (the buffer is left cleared)
+                 */
+                bool loadHex(const std::string& text)
+                {
+                        clear();
+                        buf.resize(text.size() / 2);
+                        if (!hexDecode(text.data(), text.size(), buf.data())){
+                                clear();
+                                return false;
+                        }
+                        return true;
+                }
+
+                /**
+                 * @brief Loads data decoded from base64 text, clearing any existing content.
+                 * @param text The text, with padding
+                 * @return true if the text is valid, false otherwise (the buffer is left cleared)
+                 */
+                bool loadBase64(const std::string& text)
+                {
+                        clear();
+                        unsigned int written;
+                        buf.resize(text.size() / 4 * 3);
+                        if (!base64Decode(text.data(), text.size(), buf.data(), written)){
+                                clear();
+                                return false;
+                        }
+                        buf.resize(written);
+                        return true;
+                }
+
+                /**
+                 * @brief Concatenates data to the end of the buffer.
+                 * @param data Pointer to the data to concatenate
+                 * @param size Size of the data in bytes
+                 */
+                void concat(const uint8_t * data, unsigned int size)
+                {
+                        buf.insert(buf.end(), data, data+size);
+                        pos += size;
+                }
+
+        protected:
+                template<typename T>
+                void writePacked(const std::vector<T>& vals)
+                {
+                        unsigned int count = vals.size();
+                        writeUint(count);
+                        uint32_t block[128];
+                        for (unsigned int from=0; from < count; from += 128){
+                                unsigned int n = std::min(count - from, 128u);
+                                T lo = *std::min_element(vals.begin() + from, vals.begin() + from + n);
+                                uint32_t range = 0;
+                                for (unsigned int i=0; i < n; ++i){
+                                        block[i] = (uint32_t) vals[from + i] - (uint32_t) lo;
+                                        range |= block[i];
+                                }
+                                unsigned int perLane = (n + 3) / 4;
+                                std::fill(block + n, block + 4 * perLane, 0);
+                                uint8_t width = 0;
+                                while (width < 32 && (range >> width) != 0){
+                                        ++width;
+                                }
+                                writeVarint((uint32_t) lo);
+                                buf.resize(buf.size() + 1 + 16 * ((perLane * width + 31) / 32));
+                                buf[pos++] = width;
+                                pos += bitPackLanes(block, perLane, width, buf.data() + pos);
+                        }
+                }
+
+                template<typename T>
+                void readPacked(std::vector<T>& vals)
+                {
+                        unsigned int count;
+                        readUint(count);
+                        uint32_t block[128];
+                        vals.reserve(vals.size() + count);
+                        for (unsigned int from=0; from < count; from += 128){
+                                unsigned int n = std::min(count - from, 128u);
+                                uint64_t lo;
+                                readVarint(lo);
+                                unsigned int width = buf[pos++];
+                                pos += bitUnpackLanes(buf.data() + pos, (n + 3) / 4, width, block);
+                                for (unsigned int i=0; i < n; ++i){
+                                        vals.push_back((T) (block[i] + (uint32_t) lo));
+                                }
+                        }
+                }
+
+                std::vector<uint8_t> buf;
+                unsigned int pos;
+        };
+
+        inline void Hasher::update(const ByteBuffer& buffer, unsigned int& mark)
+        {
+                update(buffer.data() + mark, buffer.size() - mark);
+                mark = buffer.size();
+        }
+
+        /**
+         * @brief Compares the bytes of two views.
+         * @return true if both views hold the same bytes, false otherwise
+         */
+        inline bool operator==(const ByteView& a, const ByteView& b)
+        {
+                return (a.size() == b.size() && std::equal(a.data(), a.data() + a.size(), b.data()));
+        }
+
+        /**
+         * @brief Compares the bytes of two buffers.
+         * @return true if both buffers hold the same bytes, false otherwise
+         */
+        inline bool operator==(const ByteBuffer& a, const ByteBuffer& b)
+        {
+                return (a.view() == b.view());
+        }
+
+        /**
+         * @brief Writes a message prefixed with a field-offset table.
+         * @details The layout is the field count, followed by fieldCount + 1 offsets
+         *          relative to the first field byte, followed by the field data.
+         *          Field i spans [offset[i], offset[i+1]), so readers can jump to any
+         *          field without decoding the ones before it. Fields are written
+         *          in increasing order straight into the output buffer; skipped
+         *          fields are encoded as empty.
+         * @code
+         * TableWriter table(buffer, 3);
+         * table.field(0).writeString("name");
+         * table.field(2).writeU64(42);
+         * table.finish();
+         * @endcode
+         */
+        class TableWriter
+        {
+        public:
+                /**
+                 * @brief Reserves the offset table at the current end of a buffer.
+                 * @param buffer The buffer to write the message to
+                 * @param fieldCount Number of fields in the message
+                 */
+                TableWriter(ByteBuffer& buffer, unsigned int fieldCount)
+                        : out(buffer), count(fieldCount), next(0)
+                {
+                        out.writeUint(count);
+                        table = out.getPos();
+                        for (unsigned int i=0; i <= count; ++i){
+                                out.writeUint(0);
+                        }
+                        base = out.getPos();
+                }
+
+                /**
+                 * @brief Starts a field.
+                 * @param i Index of the field, greater than any previously started one
+                 * @return The buffer the field value must be written to
+                 */
+                ByteBuffer& field(unsigned int i)
+                {
+                        WIRECC_ASSERT(i >= next && i < count);
+                        mark(i);
+                        return out;
+                }
+
+                /**
+                 * @brief Closes the last field and fills the remaining offsets.
+                 */
+                void finish()
+                {
+                        mark(count);
+                }
+
+        protected:
+                void mark(unsigned int upTo)
+                {
+                        unsigned int offset = out.getPos() - base;
+                        while (next <= upTo){
+                                out.writeUintAt(table + next * sizeof(uint32_t), offset);
+                                ++next;
+                        }
+                }
+
+                ByteBuffer& out;
+                unsigned int count, next, table, base;
+        private:
+                WIRECC_DISABLE_COPY_AND_ASSIGN(TableWriter);
+        };
+
+        /**
+         * @brief Gives random access to the fields of a message written by TableWriter.
+         * @details Only the offset table is parsed; fields are returned as views
+         *          into the source data, which must outlive the reader.
+         */
+        class TableReader
+        {
+        public:
+                /**
+                 * @brief Constructs an empty reader.
+                 */
+                TableReader() : table(NULL), body(NULL), count(0) {}
+
+                /**
+                 * @brief Parses the table at the current position of a buffer.
+                 * @param buffer The buffer to read from, advanced past the whole message
+                 */
+                explicit TableReader(ByteBuffer& buffer)
+                {
+                        ByteView in = buffer.view();
+                        in.setPos(buffer.getPos());
+                        load(in);
+                        buffer.setPos(in.getPos());
+                }
+
+                /**
+                 * @brief Parses the table at the current position of a view.
+                 * @param in The view to read from, advanced past the whole message
+                 */
+                explicit TableReader(ByteView& in)
+                {
+                        load(in);
+                }
+
+                /**
+                 * @brief Gets the number of fields in the message.
+                 * @return Field count
+                 */
+                unsigned int fieldCount() const {return count;}
+
+                /**
+                 * @brief Checks if a field holds any data.
+                 * @param i Index of the field
+                 * @return true if the field is present and non-empty, false otherwise
+                 */
+                bool hasField(unsigned int i) const
+                {
+                        return (i < count && offset(i) != offset(i + 1));
+                }
+
+                /**
+                 * @brief Gets a view of a single field.
+                 * @param i Index of the field (must be < fieldCount())
+                 * @return View over the field bytes
+                 */
+                ByteView field(unsigned int i) const
+                {
+                        WIRECC_ASSERT(i < count);
+                        unsigned int from = offset(i);
+                        return ByteView(body + from, offset(i + 1) - from);
+                }
+
+        protected:
+                void load(ByteView& in)
+                {
+                        in.readUint(count);
+                        table = in.data() + in.getPos();
+                        body = table + (count + 1) * sizeof(uint32_t);
+                        in.setPos(in.getPos() + (count + 1) * sizeof(uint32_t) + offset(count));
+                }
+
+                unsigned int offset(unsigned int i) const
+                {
+                        return be32decode(table + i * sizeof(uint32_t));
+                }
+
+                const uint8_t * table;
+                const uint8_t * body;
+                unsigned int count;
+        };
+
+        /**
+         * @brief Dispatches tagged fields to handlers through a jump table.
+         * @tparam C Type of the context passed to the handlers
+         * @details Handlers are indexed directly by tag, so keep tags small and dense.
+         *          Fields with unknown tags are skipped using their length prefix,
+         *          which lets older decoders read messages from newer encoders.
+         */
+        template<typename C>
+        class TagDispatcher
+        {
+        public:
+                /** @brief Handler called with the decoding context and the field value. */
+                typedef void (*Handler)(C& ctx, ByteView& value);
+
+                /**
+                 * @brief Registers the handler for a tag.
+                 * @param tag The field tag
+                 * @param handler The function to call for fields with this tag
+                 */
+                void on(unsigned int tag, Handler handler)
+                {
+                        if (tag >= handlers.size()){
+                                handlers.resize(tag + 1, NULL);
+                        }
+                        handlers[tag] = handler;
+                }
+
+                /**
+                 * @brief Decodes every tagged field until the end of the view.
+                 * @param in The view to decode, from its current position
+                 * @param ctx The context passed to the handlers
+                 * @return Number of fields skipped because their tag is unknown
+                 */
+                unsigned int dispatch(ByteView& in, C& ctx) const
+                {
+                        unsigned int unknown = 0;
+                        while (in.getPos() < in.size()){
+                                unsigned int tag;
+                                ByteView value;
+                                in.readTagged(tag, value);
+                                if (tag < handlers.size() && handlers[tag] != NULL){
+                                        handlers[tag](ctx, value);
+                                } else {
+                                        ++unknown;
+                                }
+                        }
+                        return unknown;
+                }
+
+                /**
+                 * @brief Decodes every tagged field until the end of the buffer.
+                 * @param in The buffer to decode, from its current position
+                 * @param ctx The context passed to the handlers
+                 * @return Number of fields skipped because their tag is unknown
+                 */
+                unsigned int dispatch(ByteBuffer& in, C& ctx) const
+                {
+                        ByteView view = in.view();
+                        view.setPos(in.getPos());
+                        unsigned int unknown = dispatch(view, ctx);
+                        in.setPos(view.getPos());
+                        return unknown;
+                }
+
+        protected:
+                std::vector<Handler> handlers;
+        };
+
+        /**
+         * @brief Searches a list written by ByteBuffer::writeSortedStrings() in place.
+         * @details Lookups binary search the full strings stored at restart points,
+         *          then decode at most one restart interval. The source data must
+         *          outlive the reader.
+         */
+        class SortedStringsReader
+        {
+        public:
+                /**
+                 * @brief Constructs an empty reader.
+                 */
+                SortedStringsReader() : table(NULL), body(NULL), count(0), interval(1), restarts(0) {}
+
+                /**
+                 * @brief Parses the list at the current position of a buffer.
+                 * @param buffer The buffer to read from, advanced past the whole list
+                 * @see load(ByteView&)
+                 */
+                explicit SortedStringsReader(ByteBuffer& buffer) {load(buffer);}
+
+                /**
+                 * @brief Parses the list at the current position of a view.
+                 * @param in The view to read from, advanced past the whole list
+                 * @see load(ByteView&)
+                 */
+                explicit SortedStringsReader(ByteView& in) {load(in);}
+
+                /**
+                 * @brief Parses the list at the current position of a buffer.
+                 * @param buffer The buffer to read from, advanced past the whole list
+                 * @return true if the list is well formed, false otherwise
+                 * @see load(ByteView&)
+                 */
+                bool load(ByteBuffer& buffer)
+                {
+                        ByteView in = buffer.view();
+                        in.setPos(buffer.getPos());
+                        bool ok = load(in);
+                        buffer.setPos(in.getPos());
+                        return ok;
+                }
+
+                /**
+                 * @brief Parses the list at the current position of a view.
+                 * @param in The view to read from, advanced past the whole list
+                 * @return true if the list is well formed, false otherwise (the reader
+                 *         is left empty)
+                 * @details Checks the restart table and the prefix lengths of every
+                 *          entry once, so lookups can trust them. The restart interval
+                 *          must be non-zero, and no entry may share more bytes than
+                 *          the previous entry has.
+                 */
+                bool load(ByteView& in)
+                {
+                        table = body = NULL;
+                        count = restarts = 0;
+                        interval = 1;
+                        unsigned int n, every;
+                        if (in.getPos() > in.size() || in.size() - in.getPos() < 2 * sizeof(uint32_t)){
+                                return false;
+                        }
+                        in.readUint(n);
+                        in.readUint(every);
+                        if (every == 0){
+                                return false;
+                        }
+                        unsigned int r = n / every + (n % every != 0);
+                        unsigned int left = in.size() - in.getPos();
+                        if (r >= left / sizeof(uint32_t)){
+                                return false;
+                        }
+                        const uint8_t * t = in.data() + in.getPos();
+                        const uint8_t * b = t + (r + 1) * sizeof(uint32_t);
+                        left -= (r + 1) * sizeof(uint32_t);
+                        if (be32decode(t) != 0 || be32decode(t + r * sizeof(uint32_t)) > left){
+                                return false;
+                        }
+                        for (unsigned int i=0; i < r; ++i){
+                                unsigned int from = be32decode(t + i * sizeof(uint32_t));
+                                unsigned int to = be32decode(t + (i + 1) * sizeof(uint32_t));
+                                if (from > to || !validBlock(ByteView(b + from, to - from), std::min(every, n - i * every))){
+                                        return false;
+                                }
+                        }
+                        table = t;
+                        body = b;
+                        count = n;
+                        interval = every;
+                        restarts = r;
+                        in.setPos(in.getPos() + (restarts + 1) * sizeof(uint32_t) + offset(restarts));
+                        return true;
+                }
+
+                /**
+                 * @brief Gets the number of strings in the list.
+                 * @return String count
+                 */
+                unsigned int size() const {return count;}
+
+                /**
+                 * @brief Gets the string at an index.
+                 * @param i Index of the string (must be < size())
+                 * @return The decoded string
+                 */
+                std::string get(unsigned int i) const
+                {
+                        WIRECC_ASSERT(i < count);
+                        ByteView in = block(i / interval);
+                        std::string cur;
+                        for (unsigned int n = i % interval + 1; n > 0; --n){
+                                next(in, cur);
+                        }
+                        return cur;
+                }
+
+                /**
+                 * @brief Finds the first string not less than a key.
+                 * @param key The key to search for
+                 * @return Index of the string, or size() if every string is less than key
+                 */
+                unsigned int lowerBound(const std::string& key) const
+                {
+                        // Last restart whose full string is less than key
+                        unsigned int lo = 0, hi = restarts;
+                        while (lo < hi){
+                                unsigned int mid = lo + (hi - lo) / 2;
+                                if (restartLess(mid, key)){
+                                        lo = mid + 1;
+                                } else {
+                                        hi = mid;
+                                }
+                        }
+                        if (lo == 0){
+                                return 0;
+                        }
+                        unsigned int b = lo - 1;
+                        unsigned int i = b * interval;
+                        unsigned int end = std::min(count, i + interval);
+                        ByteView in = block(b);
+                        std::string cur;
+                        for (; i < end; ++i){
+                                next(in, cur);
+                                if (cur >= key){
+                                        return i;
+                                }
+                        }
+                        return i;
+                }
+
+                /**
+                 * @brief Checks if the list contains a string.
+                 * @param key The string to look up
+                 * @return true if found, false otherwise
+                 */
+                bool contains(const std::string& key) const
+                {
+                        unsigned int i = lowerBound(key);
+                        return (i < count && get(i) == key);
+                }
+
+        protected:
+                static bool validBlock(ByteView in, unsigned int entries)
+                {
+                        uint64_t len = 0;
+                        for (; entries > 0; --entries){
+                                uint64_t shared, size;
+                                in.readVarint(shared);
+                                in.readVarint(size);
+                                if (shared > len || in.getPos() > in.size() || size > in.size() - in.getPos()){
+                                        return false;
+                                }
+                                len = shared + size;
+                                in.setPos(in.getPos() + size);
+                        }
+                        return (in.getPos() == in.size());
+                }
+
+                unsigned int offset(unsigned int r) const
+                {
+                        return be32decode(table + r * sizeof(uint32_t));
+                }
+
+                ByteView block(unsigned int r) const
+                {
+                        return ByteView(body + offset(r), offset(restarts) - offset(r));
+                }
+
+                static void next(ByteView& in, std::string& cur)
+                {
+                        uint64_t shared, size;
+                        in.readVarint(shared);
+                        in.readVarint(size);
+                        cur.resize(shared);
+                        cur.append((const char *) in.data() + in.getPos(), size);
+                        in.setPos(in.getPos() + size);
+                }
+
+                bool restartLess(unsigned int r, const std::string& key) const
+                {
+                        ByteView in = block(r);
+                        uint64_t shared, size;
+                        in.readVarint(shared);
+                        in.readVarint(size);
+                        return (key.compare(0, key.size(), (const char *) in.data() + in.getPos(), size) > 0);
+                }
+
+                const uint8_t * table;
+                const uint8_t * body;
+                unsigned int count, interval, restarts;
+        };
+
+        /**
+         * @brief Caches encoded bytes of objects that rarely change.
+         * @details Entries are keyed by object identity and hold the bytes encoded
+         *          for one version of the object; storing a newer version replaces
+         *          the older one. The total size of cached bytes is kept within a
+         *          budget by evicting the least recently used entries. Cached bytes
+         *          are SharedBuffers, so they can be handed out without copying.
+         */
+        class EncodeCache
+        {
+        public:
+                /**
+                 * @brief Constructs an empty cache.
+                 * @param budget Maximum number of cached bytes
+                 */
+                explicit EncodeCache(size_t budget) : budget(budget), used(0), hitCount(0), missCount(0) {}
+
+                /**
+                 * @brief Looks up the bytes encoded for an object version.
+                 * @param obj Identity of the object
+                 * @param version Version of the object
+                 * @param out Receives the cached bytes on a hit
+                 * @return true on a hit, false otherwise
+                 */
+                bool lookup(const void * obj, uint64_t version, SharedBuffer& out)
+                {
+                        Index::iterator it = index.find(obj);
+                        if (it == index.end() || it->second->version != version){
+                                ++missCount;
+                                return false;
+                        }
+                        ++hitCount;
+                        entries.splice(entries.begin(), entries, it->second);
+                        out = it->second->bytes;
+                        return true;
+                }
+
+                /**
+                 * @brief Stores the bytes encoded for an object version.
+                 * @param obj Identity of the object
+                 * @param version Version of the object
+                 * @param bytes The encoded bytes
+                 * @details Any entry for another version of the object is dropped.
+                 *          Bytes larger than the whole budget are not cached.
+                 */
+                void store(const void * obj, uint64_t version, const SharedBuffer& bytes)
+                {
+                        erase(obj);
+                        if (bytes.size() > budget){
+                                return;
+                        }
+                        Entry entry = {obj, version, bytes};
+                        entries.push_front(entry);
+                        index[obj] = entries.begin();
+                        used += bytes.size();
+                        while (used > budget){
+                                erase(entries.back().obj);
+                        }
+                }
+
+                /**
+                 * @brief Appends the encoding of an object, encoding it only on a miss.
+                 * @param out Buffer the bytes are concatenated to
+                 * @param obj Identity of the object
+                 * @param version Version of the object
+                 * @param encode Callable taking a ByteBuffer& and writing the object to it
+                 * @return true if cached bytes were used, false if the object was encoded
+                 */
+                template<typename F>
+                bool splice(ByteBuffer& out, const void * obj, uint64_t version, F encode)
+                {
+                        SharedBuffer bytes;
+                        bool hit = lookup(obj, version, bytes);
+                        if (!hit){
+                                ByteBuffer tmp;
+                                encode(tmp);
+                                bytes = tmp.freeze();
+                                store(obj, version, bytes);
+                        }
+                        out.concat(bytes.data(), bytes.size());
+                        return hit;
+                }
+
+                /**
+                 * @brief Drops the entry of an object.
+                 * @param obj Identity of the object
+                 */
+                void erase(const void * obj)
+                {
+                        Index::iterator it = index.find(obj);
+                        if (it != index.end()){
+                                used -= it->second->bytes.size();
+                                entries.erase(it->second);
+                                index.erase(it);
+                        }
+                }
+
+                /**
+                 * @brief Drops all entries and resets the counters.
+                 */
+                void clear()
+                {
+                        entries.clear();
+                        index.clear();
+                        used = 0;
+                        hitCount = missCount = 0;
+                }
+
+                /**
+                 * @brief Gets the number of cached entries.
+                 * @return Number of entries
+                 */
+                size_t size() const {return entries.size();}
+                /**
+                 * @brief Gets the number of cached bytes.
+                 * @return Size in bytes, never above the budget
+                 */
+                size_t bytes() const {return used;}
+                /**
+                 * @brief Gets the number of lookups that found the requested version.
+                 * @return Number of hits
+                 */
+                uint64_t hits() const {return hitCount;}
+                /**
+                 * @brief Gets the number of lookups that had to encode.
+                 * @return Number of misses
+                 */
+                uint64_t misses() const {return missCount;}
+                /**
+                 * @brief Gets the fraction of lookups that were hits.
+                 * @return Hit rate between 0 and 1, 0 if there were no lookups
+                 */
+                double hitRate() const
+                {
+                        uint64_t total = hitCount + missCount;
+                        return (total > 0 ? (double) hitCount / total : 0.0);
+                }
+
+        protected:
+                struct Entry
+                {
+                        const void * obj;
+                        uint64_t version;
+                        SharedBuffer bytes;
+                };
+                typedef std::list<Entry> Entries;
+                typedef std::unordered_map<const void *, Entries::iterator> Index;
+
+                Entries entries;
+                Index index;
+                size_t budget, used;
+                uint64_t hitCount, missCount;
+        };
+
+        /**
+         * @brief A bitmap class for managing bit flags.
+         * @details Provides functionality to set, unset, and check individual bits
+         *          within a 64-bit integer. Supports custom maximum bit counts.
+         */
+        class Bitmap
+        {
+        public:
+                /**
+                 * @brief Constructs a bitmap with specified maximum bits.
+                 * @param maxBits Maximum number of bits to support (default: 64)
+                 */
+                Bitmap(uint8_t maxBits=64)
+                {
+                        clear();
+                        mask = (maxBits >= 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << maxBits) - (uint64_t) 1);
+                }
+
+                /**
+                 * @brief Checks if a specific bit is set.
+                 * @param bit The bit position to check
+                 * @return true if the bit is set, false otherwise
+                 */
+                bool isSet(unsigned int bit) const
+                {
+                        return ((flags & ((uint64_t) 1 << bit)) > 0);
+                }
+
+                /**
+                 * @brief Checks if the bitmap is empty (no bits set).
+                 * @return true if no bits are set, false otherwise
+                 */
+                bool isEmpty() const
+                {
+                        return (flags == (uint64_t) 0);
+                }
+
+                /**
+                 * @brief Checks if the bitmap is full (all allowed bits set).
+                 * @return true if all bits within the mask are set, false otherwise
+                 */
+                bool isFull() const
+                {
+                        return (flags == mask);
+                }
+
+                /**
+                 * @brief Sets a specific bit.
+                 * @param bit The bit position to set (must be < 64)
+                 */
+                void set(unsigned int bit)
+                {
+                        WIRECC_ASSERT(bit < 64);
+                        flags |= ((uint64_t) 1 << bit);
+                }
+
+                /**
+                 * @brief Unsets (clears) a specific bit.
+                 * @param bit The bit position to unset
+                 */
+                void unset(unsigned int bit)
+                {
+                        flags &= (mask ^ ((uint64_t) 1 << bit));
+                }
+
+                /**
+                 * @brief Clears all bits in the bitmap.
+                 */
+                void clear()
+                {
+                        flags = 0;
+                }
+
+                /**
+                 * @brief Replaces all flags at once.
+                 * @param val The new flags, bits beyond the maximum are dropped
+                 */
+                void setFlags(uint64_t val)
+                {
+                        flags = (val & mask);
+                }
+
+                /**
+                 * @brief Gets the current flags as a 64-bit unsigned integer.
+                 * @return The current flags
+                 */
+                uint64_t getFlags() const
+                {
+                        return flags;
+                }
+
+        protected:
+                uint64_t flags, mask;
+        };
+
+        /**
+         * @brief Transposes a 64x64 bit matrix in place.
+         * @param rows The matrix, bit j of rows[i] being the element at row i, column j
+         * @details Swaps ever smaller blocks across the diagonal, in 6 passes of
+         *          word operations instead of 4096 bit moves.
+         */
+        inline void transpose64(uint64_t * rows)
+        {
+                uint64_t m = 0x00000000FFFFFFFFULL;
+                for (unsigned int j=32; j != 0; j >>= 1, m ^= (m << j)){
+                        for (unsigned int k=0; k < 64; k = ((k | j) + 1) & ~j){
+                                uint64_t t = ((rows[k] >> j) ^ rows[k | j]) & m;
+                                rows[k] ^= t << j;
+                                rows[k | j] ^= t;
+                        }
+                }
+        }
+
+        /**
+         * @brief Flags of many resources stored as one bitset per flag.
+         * @details Holds up to 64 flags for each non-negative ResourceId, the
+         *          transposed layout of keeping one Bitmap per resource. Finding the
+         *          ids with some flags set and others unset is a pass of word-wise
+         *          AND / AND NOT over the flag columns instead of a scan of every
+         *          resource. Rows are converted to and from that layout 64 at a
+         *          time with transpose64().
+         */
+        class BitMatrix
+        {
+        public:
+                /**
+                 * @brief Constructs an empty matrix.
+                 * @param flagCount Number of flags per resource, up to 64
+                 */
+                explicit BitMatrix(unsigned int flagCount=64) : columns(flagCount), words(0), rows(0)
+                {
+                        WIRECC_ASSERT(flagCount <= 64);
+                }
+
+                /**
+                 * @brief Sets a flag of a resource.
+                 * @param rid The resource, non-negative
+                 * @param flag The flag
+                 */
+                void set(ResourceId rid, unsigned int flag)
+                {
+                        WIRECC_ASSERT(rid >= 0 && flag < columns.size());
+                        reserve(rid);
+                        columns[flag][rid / 64] |= (uint64_t) 1 << (rid % 64);
+                }
+
+                /**
+                 * @brief Unsets a flag of a resource.
+                 * @param rid The resource, non-negative
+                 * @param flag The flag
+                 */
+                void unset(ResourceId rid, unsigned int flag)
+                {
+                        WIRECC_ASSERT(rid >= 0 && flag < columns.size());
+                        if ((size_t) rid / 64 < words){
+                                columns[flag][rid / 64] &= ~((uint64_t) 1 << (rid % 64));
+                        }
+                }
+
+                /**
+                 * @brief Checks a flag of a resource.
+                 * @param rid The resource, non-negative
+                 * @param flag The flag
+                 * @return true if set, false otherwise
+                 */
+                bool isSet(ResourceId rid, unsigned int flag) const
+                {
+                        WIRECC_ASSERT(rid >= 0 && flag < columns.size());
+                        return ((size_t) rid / 64 < words && ((columns[flag][rid / 64] >> (rid % 64)) & 1));
+                }
+
+                /**
+                 * @brief Replaces all flags of a resource.
+                 * @param rid The resource, non-negative
+                 * @param flags The new flags
+                 */
+                void setRow(ResourceId rid, const Bitmap& flags)
+                {
+                        WIRECC_ASSERT(rid >= 0);
+                        reserve(rid);
+                        uint64_t bits = flags.getFlags();
+                        for (unsigned int f=0; f < columns.size(); ++f){
+                                uint64_t& word = columns[f][rid / 64];
+                                word = (word & ~((uint64_t) 1 << (rid % 64))) | (((bits >> f) & 1) << (rid % 64));
+                        }
+                }
+
+                /**
+                 * @brief Gets all flags of a resource.
+                 * @param rid The resource, non-negative
+                 * @return Bitmap of the flags, empty for resources never set
+                 */
+                Bitmap row(ResourceId rid) const
+                {
+                        WIRECC_ASSERT(rid >= 0);
+                        Bitmap ret((uint8_t) columns.size());
+                        if ((size_t) rid / 64 < words){
+                                uint64_t bits = 0;
+                                for (unsigned int f=0; f < columns.size(); ++f){
+                                        bits |= ((columns[f][rid / 64] >> (rid % 64)) & 1) << f;
+                                }
+                                ret.setFlags(bits);
+                        }
+                        return ret;
+                }
+
+                /**
+                 * @brief Replaces the flags of consecutive resources.
+                 * @param first The first resource, non-negative
+                 * @param rows Flags of resources first, first + 1, ...
+                 */
+                void setRows(ResourceId first, const std::vector<Bitmap>& rows)
+                {
+                        WIRECC_ASSERT(first >= 0);
+                        if (rows.empty()){
+                                return;
+                        }
+                        reserve(first + rows.size() - 1);
+                        uint64_t block[64];
+                        size_t end = first + rows.size();
+                        for (size_t base = first / 64 * 64; base < end; base += 64){
+                                loadBlock(base / 64, block);
+                                for (size_t i = std::max<size_t>(base, first); i < std::min(base + 64, end); ++i){
+                                        block[i - base] = rows[i - first].getFlags();
+                                }
+                                storeBlock(base / 64, block);
+                        }
+                }
+
+                /**
+                 * @brief Gets the flags of consecutive resources.
+                 * @param first The first resource, non-negative
+                 * @param count Number of resources
+                 * @param rows Vector to append the flags of resources first, first + 1, ... to
+                 */
+                void getRows(ResourceId first, unsigned int count, std::vector<Bitmap>& rows) const
+                {
+                        WIRECC_ASSERT(first >= 0);
+                        uint64_t block[64];
+                        size_t end = first + count;
+                        for (size_t base = first / 64 * 64; base < end; base += 64){
+                                loadBlock(base / 64, block);
+                                for (size_t i = std::max<size_t>(base, first); i < std::min(base + 64, end); ++i){
+                                        rows.push_back(Bitmap((uint8_t) columns.size()));
+                                        rows.back().setFlags(block[i - base]);
+                                }
+                        }
+                }
+
+                /**
+                 * @brief Finds the resources with some flags set and others unset.
+                 * @param required Flags that must be set
+                 * @param forbidden Flags that must be unset
+                 * @param ids Receives the matching ids in increasing order
+                 * @details Only resources below rowCount() are considered.
+                 */
+                void select(uint64_t required, uint64_t forbidden, FlatResourceSet& ids) const
+                {
+                        ids.clear();
+                        scan(required, forbidden, [&ids](size_t w, uint64_t bits) {
+                                for (; bits != 0; bits &= bits - 1){
+                                        ids.push_back((ResourceId) (w * 64 + __builtin_ctzll(bits)));
+                                }
+                        });
+                }
+
+                /**
+                 * @brief Counts the resources with some flags set and others unset.
+                 * @param required Flags that must be set
+                 * @param forbidden Flags that must be unset
+                 * @return Number of matching resources
+                 */
+                size_t count(uint64_t required, uint64_t forbidden) const
+                {
+                        size_t ret = 0;
+                        scan(required, forbidden, [&ret](size_t, uint64_t bits) {
+                                ret += __builtin_popcountll(bits);
+                        });
+                        return ret;
+                }
+
+                /**
+                 * @brief Gets the bitset of a flag.
+                 * @param flag The flag
+                 * @return Words where bit i of word w is the flag of resource w * 64 + i,
+                 *         covering at least rowCount() resources
+                 */
+                const std::vector<uint64_t>& column(unsigned int flag) const
+                {
+                        WIRECC_ASSERT(flag < columns.size());
+                        return columns[flag];
+                }
+
+                /**
+                 * @brief Gets the number of resources covered.
+                 * @return Highest resource ever set plus one
+                 */
+                size_t rowCount() const {return rows;}
+
+                /**
+                 * @brief Unsets all flags of all resources.
+                 */
+                void clear()
+                {
+                        for (unsigned int f=0; f < columns.size(); ++f){
+                                columns[f].clear();
+                        }
+                        words = 0;
+                        rows = 0;
+                }
+
+        protected:
+                void reserve(size_t rid)
+                {
+                        rows = std::max(rows, rid + 1);
+                        if (rid / 64 < words){
+                                return;
+                        }
+                        words = std::max(rid / 64 + 1, words * 2);
+                        for (unsigned int f=0; f < columns.size(); ++f){
+                                columns[f].resize(words, 0);
+                        }
+                }
+
+                void loadBlock(size_t w, uint64_t * block) const
+                {
+                        std::fill(block, block + 64, 0);
+                        if (w < words){
+                                for (unsigned int f=0; f < columns.size(); ++f){
+                                        block[f] = columns[f][w];
+                                }
+                        }
+                        transpose64(block);
+                }
+
+                void storeBlock(size_t w, uint64_t * block)
                 {
-                        buf.resize(buf.size() + sizeof(uint64_t));
-                        be64encode(val, &buf[pos]);
-                        pos += sizeof(uint64_t);
+                        transpose64(block);
+                        for (unsigned int f=0; f < columns.size(); ++f){
+                                columns[f][w] = block[f];
+                        }
                 }
 
-                /**
-                 * @brief Reads an unsigned integer from the buffer.
-                 * @param val Reference to store the read value
-                 */
-                void readUint(unsigned int& val)
+                // Calls fn(w, bits) with the matching bits of every word w
+                template<typename F>
+                void scan(uint64_t required, uint64_t forbidden, F fn) const
                 {
-                        val = be32decode(&buf[pos]);
-                        pos += sizeof(uint32_t);
+                        std::vector<const uint64_t *> with, without;
+                        for (unsigned int f=0; f < columns.size(); ++f){
+                                if ((required >> f) & 1){
+                                        with.push_back(columns[f].data());
+                                }
+                                if ((forbidden >> f) & 1){
+                                        without.push_back(columns[f].data());
+                                }
+                        }
+                        if (columns.size() < 64 && (required >> columns.size()) != 0){
+                                return;
+                        }
+                        // Rows past rowCount() in the last word never match
+                        size_t used = (rows + 63) / 64;
+                        uint64_t tail = (rows % 64 == 0 ? ~(uint64_t) 0 : ((uint64_t) 1 << (rows % 64)) - 1);
+                        auto emit = [&fn, used, tail](size_t w, uint64_t bits) {
+                                fn(w, (w + 1 == used ? bits & tail : bits));
+                        };
+                        size_t w = 0;
+#if defined(__AVX2__)
+                        for (; w + 4 <= used; w += 4){
+                                __m256i acc = _mm256_set1_epi64x(-1);
+                                for (size_t i=0; i < with.size(); ++i){
+                                        acc = _mm256_and_si256(acc, _mm256_loadu_si256((const __m256i *) (with[i] + w)));
+                                }
+                                for (size_t i=0; i < without.size(); ++i){
+                                        acc = _mm256_andnot_si256(_mm256_loadu_si256((const __m256i *) (without[i] + w)), acc);
+                                }
+                                uint64_t bits[4];
+                                _mm256_storeu_si256((__m256i *) bits, acc);
+                                for (unsigned int k=0; k < 4; ++k){
+                                        emit(w + k, bits[k]);
+                                }
+                        }
+#elif defined(__SSE2__)
+                        for (; w + 2 <= used; w += 2){
+                                __m128i acc = _mm_set1_epi32(-1);
+                                for (size_t i=0; i < with.size(); ++i){
+                                        acc = _mm_and_si128(acc, _mm_loadu_si128((const __m128i *) (with[i] + w)));
+                                }
+                                for (size_t i=0; i < without.size(); ++i){
+                                        acc = _mm_andnot_si128(_mm_loadu_si128((const __m128i *) (without[i] + w)), acc);
+                                }
+                                uint64_t bits[2];
+                                _mm_storeu_si128((__m128i *) bits, acc);
+                                emit(w, bits[0]);
+                                emit(w + 1, bits[1]);
+                        }
+#endif
+                        for (; w < used; ++w){
+                                uint64_t acc = ~(uint64_t) 0;
+                                for (size_t i=0; i < with.size(); ++i){
+                                        acc &= with[i][w];
+                                }
+                                for (size_t i=0; i < without.size(); ++i){
+                                        acc &= ~without[i][w];
+                                }
+                                emit(w, acc);
+                        }
                 }
 
+                std::vector<std::vector<uint64_t> > columns;
+                size_t words, rows;
+        };
+
+        /**
+         * @brief Encodes successive snapshots of a message as deltas.
+         * @details A message has up to 64 byte fields and up to 64 ResourceSet fields.
+         *          Each encode() sends a Bitmap of the changed byte fields with their
+         *          new values, and a Bitmap of the changed sets with the ids added to
+         *          and removed from them, so the output is proportional to what
+         *          changed since the previous encode() of the same stream. Use one
+         *          encoder per stream, paired with a DeltaDecoder on the other side.
+         */
+        class DeltaEncoder
+        {
+        public:
                 /**
-                 * @brief Writes an unsigned integer to the buffer.
-                 * @param val The value to write
+                 * @brief Constructs an encoder whose first message is a keyframe.
                  */
-                void writeUint(unsigned int val)
-                {
-                        buf.resize(buf.size() + sizeof(uint32_t));
-                        be32encode(val, &buf[pos]);
-                        pos += sizeof(uint32_t);
-                }
+                DeltaEncoder() : fields(64), sets(64), added(64), removed(64), keyframe(true) {}
 
                 /**
-                 * @brief Reads a signed integer from the buffer.
-                 * @param val Reference to store the read value
+                 * @brief Sets the value of a byte field.
+                 * @param i Index of the field (must be < 64)
+                 * @param value The encoded field value
+                 * @details The field is only sent if its bytes differ from the previous value.
                  */
-                void readInt(int& val)
+                void setField(unsigned int i, const ByteBuffer& value)
                 {
-                        unsigned int tmp;
-                        readUint(tmp);
-                        val = tmp;
+                        WIRECC_ASSERT(i < 64);
+                        std::vector<uint8_t>& cur = fields[i];
+                        if (cur.size() != value.size() ||
+                            !std::equal(cur.begin(), cur.end(), value.data())){
+                                cur.assign(value.data(), value.data() + value.size());
+                                changedFields.set(i);
+                        }
                 }
 
                 /**
-                 * @brief Writes a signed integer to the buffer.
-                 * @param val The value to write
+                 * @brief Adds an id to a set field.
+                 * @param i Index of the set (must be < 64)
+                 * @param rid The id to add
                  */
-                void writeInt(int val)
+                void insert(unsigned int i, ResourceId rid)
                 {
-                        unsigned int tmp = val;
-                        writeUint(tmp);
+                        WIRECC_ASSERT(i < 64);
+                        if (sets[i].insert(rid).second){
+                                if (removed[i].erase(rid) == 0){
+                                        added[i].insert(rid);
+                                }
+                                changedSets.set(i);
+                        }
                 }
 
                 /**
-                 * @brief Reads a ResourceSet from the buffer.
-                 * @param val Reference to the ResourceSet to populate
+                 * @brief Removes an id from a set field.
+                 * @param i Index of the set (must be < 64)
+                 * @param rid The id to remove
                  */
-                void readRset(ResourceSet& val)
+                void erase(unsigned int i, ResourceId rid)
                 {
-                        uint32_t size;
-                        readUint(size);
-                        while (size-- > 0){
-                                ResourceId r;
-                                readInt(r);
-                                val.insert(r);
+                        WIRECC_ASSERT(i < 64);
+                        if (sets[i].erase(rid) > 0){
+                                if (added[i].erase(rid) == 0){
+                                        removed[i].insert(rid);
+                                }
+                                changedSets.set(i);
                         }
                 }
 
                 /**
-                 * @brief Writes a ResourceSet to the buffer.
-                 * @param val The ResourceSet to write
+                 * @brief Replaces the contents of a set field.
+                 * @param i Index of the set (must be < 64)
+                 * @param val The new contents
+                 * @details Costs a linear scan of both sets; prefer insert() and erase()
+                 *          when the changes are known.
                  */
-                void writeRset(const ResourceSet& val)
+                void setRset(unsigned int i, const ResourceSet& val)
                 {
-                        uint32_t size = val.size();
-                        writeUint(size);
-                        for (ResourceIterator itr = ResourceIterator(val);
-                             itr.current != itr.end; ++itr.current) {
-                                writeInt(*itr.current);
+                        WIRECC_ASSERT(i < 64);
+                        ResourceSet toAdd, toRemove;
+                        std::set_difference(val.begin(), val.end(), sets[i].begin(), sets[i].end(),
+                                            std::inserter(toAdd, toAdd.end()));
+                        std::set_difference(sets[i].begin(), sets[i].end(), val.begin(), val.end(),
+                                            std::inserter(toRemove, toRemove.end()));
+                        for (ResourceSet::const_iterator itr = toAdd.begin(); itr != toAdd.end(); ++itr){
+                                insert(i, *itr);
+                        }
+                        for (ResourceSet::const_iterator itr = toRemove.begin(); itr != toRemove.end(); ++itr){
+                                erase(i, *itr);
                         }
                 }
 
                 /**
-                 * @brief Reads a string from the buffer.
-                 * @param val Reference to the string to populate
+                 * @brief Makes the next encode() send the full state.
+                 * @details Use it to resynchronize a decoder that lost messages.
                  */
-                void readString(std::string& val)
+                void reset()
                 {
-                        uint32_t size;
-                        readUint(size);
-                        while (size-- > 0){
-                                val.push_back(*(&buf[pos]));
-                                ++pos;
-                        }
+                        keyframe = true;
                 }
 
                 /**
-                 * @brief Writes a string to the buffer.
-                 * @param val The string to write
+                 * @brief Writes the changes since the previous encode().
+                 * @param out The buffer to write the delta to
                  */
-                void writeString(const std::string& val)
+                void encode(ByteBuffer& out)
                 {
-                        uint32_t size = val.size();
-                        writeUint(size);
-                        buf.resize(buf.size() + size);
-                        for (unsigned int i=0; i < size; ++i){
-                                *(&buf[pos]) = val[i];
-                                ++pos;
+                        if (keyframe){
+                                changedFields.clear();
+                                changedSets.clear();
+                                for (unsigned int i=0; i < 64; ++i){
+                                        if (!fields[i].empty()){
+                                                changedFields.set(i);
+                                        }
+                                        removed[i].clear();
+                                        added[i] = sets[i];
+                                        if (!sets[i].empty()){
+                                                changedSets.set(i);
+                                        }
+                                }
+                        }
+                        for (unsigned int i=0; i < 64; ++i){
+                                if (changedSets.isSet(i) && added[i].empty() && removed[i].empty()){
+                                        changedSets.unset(i);
+                                }
+                        }
+                        out.writeBool(keyframe);
+                        out.writeU64(changedFields.getFlags());
+                        out.writeU64(changedSets.getFlags());
+                        for (unsigned int i=0; i < 64; ++i){
+                                if (changedFields.isSet(i)){
+                                        out.writeUint(fields[i].size());
+                                        out.concat(fields[i].data(), fields[i].size());
+                                }
+                        }
+                        for (unsigned int i=0; i < 64; ++i){
+                                if (changedSets.isSet(i)){
+                                        out.writeRset(added[i]);
+                                        out.writeRset(removed[i]);
+                                        added[i].clear();
+                                        removed[i].clear();
+                                }
                         }
+                        changedFields.clear();
+                        changedSets.clear();
+                        keyframe = false;
                 }
 
+        protected:
+                std::vector<std::vector<uint8_t> > fields;
+                std::vector<ResourceSet> sets, added, removed;
+                Bitmap changedFields, changedSets;
+                bool keyframe;
+        };
+
+        /**
+         * @brief Rebuilds message snapshots from the deltas written by DeltaEncoder.
+         */
+        class DeltaDecoder
+        {
+        public:
                 /**
-                 * @brief Writes a C-style string to the buffer.
-                 * @param val The null-terminated string to write
+                 * @brief Constructs a decoder with every field empty.
                  */
-                void writeCstring(const char * val)
-                {
-                        writeString(std::string(val));
-                }
+                DeltaDecoder() : fields(64), sets(64) {}
 
                 /**
-                 * @brief Reads a boolean value from the buffer.
-                 * @param val Reference to store the read boolean value
+                 * @brief Applies a delta read from the current position of a buffer.
+                 * @param in The buffer to read the delta from
                  */
-                void readBool(bool& val)
+                void apply(ByteBuffer& in)
                 {
-                        val = (*(&buf[pos]) != 0);
-                        ++pos;
+                        ByteView view = in.view();
+                        view.setPos(in.getPos());
+                        apply(view);
+                        in.setPos(view.getPos());
                 }
 
                 /**
-                 * @brief Writes a boolean value to the buffer.
-                 * @param val The boolean value to write
+                 * @brief Applies a delta read from the current position of a view.
+                 * @param in The view to read the delta from
                  */
-                void writeBool(bool val)
+                void apply(ByteView& in)
                 {
-                        buf.resize(buf.size() + 1);
-                        *(&buf[pos]) = (val ? 1 : 0);
-                        ++pos;
+                        bool keyframe;
+                        uint64_t flags;
+                        in.readBool(keyframe);
+                        if (keyframe){
+                                for (unsigned int i=0; i < 64; ++i){
+                                        fields[i].clear();
+                                        sets[i].clear();
+                                }
+                        }
+                        in.readU64(flags);
+                        changedFields.setFlags(flags);
+                        in.readU64(flags);
+                        changedSets.setFlags(flags);
+                        for (unsigned int i=0; i < 64; ++i){
+                                if (changedFields.isSet(i)){
+                                        ByteView value;
+                                        in.readBuffer(value);
+                                        fields[i].assign(value.data(), value.data() + value.size());
+                                }
+                        }
+                        for (unsigned int i=0; i < 64; ++i){
+                                if (changedSets.isSet(i)){
+                                        ResourceSet& cur = sets[i];
+                                        in.readRset(cur);
+                                        uint32_t size;
+                                        in.readUint(size);
+                                        while (size-- > 0){
+                                                ResourceId r;
+                                                in.readInt(r);
+                                                cur.erase(r);
+                                        }
+                                }
+                        }
                 }
 
                 /**
-                 * @brief Gets a pointer to the raw buffer data.
-                 * @return Const pointer to the internal buffer
+                 * @brief Gets the current value of a byte field.
+                 * @param i Index of the field (must be < 64)
+                 * @return View valid until the next apply()
                  */
-                const uint8_t * data() const {return &buf[0];}
+                ByteView field(unsigned int i) const
+                {
+                        WIRECC_ASSERT(i < 64);
+                        return ByteView(fields[i].data(), fields[i].size());
+                }
+
                 /**
-                 * @brief Gets the size of the buffer.
-                 * @return Size of the buffer in bytes
+                 * @brief Gets the current contents of a set field.
+                 * @param i Index of the set (must be < 64)
+                 * @return The set contents
                  */
-                unsigned int size() const {return buf.size();}
+                const ResourceSet& rset(unsigned int i) const
+                {
+                        WIRECC_ASSERT(i < 64);
+                        return sets[i];
+                }
+
                 /**
-                 * @brief Clears the buffer and resets position to 0.
+                 * @brief Gets the byte fields changed by the last apply().
+                 * @return Bitmap of field indexes
                  */
-                void clear() {buf.clear(); pos = 0;}
+                const Bitmap& getChangedFields() const {return changedFields;}
                 /**
-                 * @brief Sets the current position in the buffer.
-                 * @param newPos The new position to set
+                 * @brief Gets the set fields changed by the last apply().
+                 * @return Bitmap of set indexes
                  */
-                void setPos(unsigned int newPos) {pos = newPos;}
+                const Bitmap& getChangedSets() const {return changedSets;}
+
+        protected:
+                std::vector<std::vector<uint8_t> > fields;
+                std::vector<ResourceSet> sets;
+                Bitmap changedFields, changedSets;
+        };
+
+        /**
+         * @brief Compresses a series of timestamped doubles, Gorilla style.
+         * @details Timestamps are stored as delta-of-deltas in variable-size buckets,
+         *          so regular intervals take a single bit. Values are XORed with the
+         *          previous one and only the meaningful bits are stored, reusing the
+         *          previous leading/trailing zero window when it fits.
+         */
+        class TimeSeriesEncoder
+        {
+        public:
                 /**
-                 * @brief Gets the current position in the buffer.
-                 * @return Current position in bytes
+                 * @brief Constructs an empty series.
                  */
-                unsigned int getPos() const {return pos;}
+                TimeSeriesEncoder() : count(0), prevTime(0), prevDelta(0), prevBits(0), prevLead(64), prevTrail(0) {}
+
                 /**
-                 * @brief Loads data into the buffer, clearing any existing content.
-                 * @param data Pointer to the data to load
-                 * @param size Size of the data in bytes
+                 * @brief Appends a point.
+                 * @param timestamp The point timestamp
+                 * @param val The point value
                  */
-                void load(const uint8_t * data, unsigned int size)
+                void append(int64_t timestamp, double val)
                 {
-                        clear();
-                        buf.insert(buf.begin(), data, data+size);
+                        uint64_t bits;
+                        memcpy(&bits, &val, sizeof(bits));
+                        if (count == 0){
+                                stream.writeBits(timestamp, 64);
+                                stream.writeBits(bits, 64);
+                        } else {
+                                int64_t delta = (int64_t) ((uint64_t) timestamp - (uint64_t) prevTime);
+                                writeTime((int64_t) ((uint64_t) delta - (uint64_t) prevDelta));
+                                writeValue(bits ^ prevBits);
+                                prevDelta = delta;
+                        }
+                        prevTime = timestamp;
+                        prevBits = bits;
+                        ++count;
                 }
 
                 /**
-                 * @brief Concatenates data to the end of the buffer.
-                 * @param data Pointer to the data to concatenate
-                 * @param size Size of the data in bytes
+                 * @brief Gets the number of points.
+                 * @return Point count
                  */
-                void concat(const uint8_t * data, unsigned int size)
+                unsigned int size() const {return count;}
+
+                /**
+                 * @brief Writes the series as a nested buffer.
+                 * @param out The buffer to write to
+                 */
+                void write(ByteBuffer& out) const
                 {
-                        buf.insert(buf.end(), data, data+size);
-                        pos += size;
+                        out.writeUint(count);
+                        out.writeBits(stream);
                 }
 
         protected:
-                std::vector<uint8_t> buf;
-                unsigned int pos;
+                void writeTime(int64_t dod)
+                {
+                        if (dod == 0){
+                                stream.writeBits(0, 1);
+                        } else if (dod >= -64 && dod <= 63){
+                                stream.writeBits(2, 2);
+                                stream.writeBits(dod, 7);
+                        } else if (dod >= -256 && dod <= 255){
+                                stream.writeBits(6, 3);
+                                stream.writeBits(dod, 9);
+                        } else if (dod >= -2048 && dod <= 2047){
+                                stream.writeBits(14, 4);
+                                stream.writeBits(dod, 12);
+                        } else {
+                                stream.writeBits(15, 4);
+                                stream.writeBits(dod, 64);
+                        }
+                }
+
+                void writeValue(uint64_t x)
+                {
+                        if (x == 0){
+                                stream.writeBit(false);
+                                return;
+                        }
+                        stream.writeBit(true);
+                        unsigned int lead = std::min(__builtin_clzll(x), 31);
+                        unsigned int trail = __builtin_ctzll(x);
+                        // prevLead starts at 64 so that the first window is written explicitly
+                        if (lead >= prevLead && trail >= prevTrail){
+                                stream.writeBit(false);
+                                stream.writeBits(x >> prevTrail, 64 - prevLead - prevTrail);
+                                return;
+                        }
+                        stream.writeBit(true);
+                        stream.writeBits(lead, 5);
+                        stream.writeBits(63 - lead - trail, 6);
+                        stream.writeBits(x >> trail, 64 - lead - trail);
+                        prevLead = lead;
+                        prevTrail = trail;
+                }
+
+                BitWriter stream;
+                unsigned int count;
+                int64_t prevTime, prevDelta;
+                uint64_t prevBits;
+                unsigned int prevLead, prevTrail;
         };
 
         /**
-         * @brief A bitmap class for managing bit flags.
-         * @details Provides functionality to set, unset, and check individual bits
-         *          within a 64-bit integer. Supports custom maximum bit counts.
+         * @brief Decompresses a series written by TimeSeriesEncoder.
+         * @details Points are decoded one at a time from the source data, which must
+         *          outlive the decoder.
          */
-        class Bitmap
+        class TimeSeriesDecoder
         {
         public:
                 /**
-                 * @brief Constructs a bitmap with specified maximum bits.
-                 * @param maxBits Maximum number of bits to support (default: 64)
+                 * @brief Reads the series at the current position of a buffer.
+                 * @param in The buffer to read from, advanced past the series
                  */
-                Bitmap(uint8_t maxBits=64)
+                explicit TimeSeriesDecoder(ByteBuffer& in)
                 {
-                        clear();
-                        mask = (uint64_t) std::pow(2, maxBits) - (uint64_t) 1;
+                        in.readUint(count);
+                        in.readBits(stream);
+                        reset();
                 }
 
                 /**
-                 * @brief Checks if a specific bit is set.
-                 * @param bit The bit position to check
-                 * @return true if the bit is set, false otherwise
+                 * @brief Reads the series at the current position of a view.
+                 * @param in The view to read from, advanced past the series
                  */
-                bool isSet(unsigned int bit) const
+                explicit TimeSeriesDecoder(ByteView& in)
                 {
-                        return ((flags & ((uint64_t) 1 << bit)) > 0);
+                        in.readUint(count);
+                        in.readBits(stream);
+                        reset();
                 }
 
                 /**
-                 * @brief Checks if the bitmap is empty (no bits set).
-                 * @return true if no bits are set, false otherwise
+                 * @brief Gets the number of points in the series.
+                 * @return Point count
                  */
-                bool isEmpty() const
-                {
-                        return (flags == (uint64_t) 0);
-                }
+                unsigned int size() const {return count;}
 
                 /**
-                 * @brief Checks if the bitmap is full (all allowed bits set).
-                 * @return true if all bits within the mask are set, false otherwise
+                 * @brief Decodes the next point.
+                 * @param timestamp Reference to store the point timestamp
+                 * @param val Reference to store the point value
+                 * @return true if a point was decoded, false at the end of the series
                  */
-                bool isFull() const
+                bool next(int64_t& timestamp, double& val)
                 {
-                        return (flags == mask);
+                        if (done == count){
+                                return false;
+                        }
+                        if (done == 0){
+                                prevTime = stream.readBits(64);
+                                prevBits = stream.readBits(64);
+                        } else {
+                                prevDelta = (int64_t) ((uint64_t) prevDelta + (uint64_t) readTime());
+                                prevTime = (int64_t) ((uint64_t) prevTime + (uint64_t) prevDelta);
+                                prevBits ^= readValue();
+                        }
+                        ++done;
+                        timestamp = prevTime;
+                        memcpy(&val, &prevBits, sizeof(val));
+                        return true;
                 }
 
-                /**
-                 * @brief Sets a specific bit.
-                 * @param bit The bit position to set (must be < 64)
-                 */
-                void set(unsigned int bit)
+        protected:
+                void reset()
                 {
-                        WIRECC_ASSERT(bit < 64);
-                        flags |= ((uint64_t) 1 << bit);
+                        done = 0;
+                        prevTime = prevDelta = 0;
+                        prevBits = 0;
+                        prevLead = prevTrail = 0;
                 }
 
-                /**
-                 * @brief Unsets (clears) a specific bit.
-                 * @param bit The bit position to unset
-                 */
-                void unset(unsigned int bit)
+                static int64_t signExtend(uint64_t val, unsigned int bits)
                 {
-                        flags &= (mask ^ ((uint64_t) 1 << bit));
+                        uint64_t sign = (uint64_t) 1 << (bits - 1);
+                        return (int64_t) ((val ^ sign) - sign);
                 }
 
-                /**
-                 * @brief Clears all bits in the bitmap.
-                 */
-                void clear()
+                int64_t readTime()
                 {
-                        flags = 0;
+                        if (!stream.readBit()){
+                                return 0;
+                        }
+                        if (!stream.readBit()){
+                                return signExtend(stream.readBits(7), 7);
+                        }
+                        if (!stream.readBit()){
+                                return signExtend(stream.readBits(9), 9);
+                        }
+                        if (!stream.readBit()){
+                                return signExtend(stream.readBits(12), 12);
+                        }
+                        return (int64_t) stream.readBits(64);
                 }
 
-                /**
-                 * @brief Gets the current flags as a 64-bit unsigned integer.
-                 * @return The current flags
-                 */
-                uint64_t getFlags() const
+                uint64_t readValue()
                 {
-                        return flags;
+                        if (!stream.readBit()){
+                                return 0;
+                        }
+                        if (stream.readBit()){
+                                prevLead = stream.readBits(5);
+                                prevTrail = 64 - prevLead - (stream.readBits(6) + 1);
+                        }
+                        return stream.readBits(64 - prevLead - prevTrail) << prevTrail;
                 }
 
-        protected:
-                uint64_t flags, mask;
+                BitReader stream;
+                unsigned int count, done;
+                int64_t prevTime, prevDelta;
+                uint64_t prevBits;
+                unsigned int prevLead, prevTrail;
+        };
+}
+
+namespace std {
+        /** @brief Hashes the bytes of a ByteBuffer with WireCC::hashBytes(). */
+        template<>
+        struct hash<WireCC::ByteBuffer>
+        {
+                size_t operator()(const WireCC::ByteBuffer& val) const
+                {
+                        return WireCC::hashBytes(val.data(), val.size());
+                }
+        };
+
+        /** @brief Hashes the bytes of a ByteView with WireCC::hashBytes(). */
+        template<>
+        struct hash<WireCC::ByteView>
+        {
+                size_t operator()(const WireCC::ByteView& val) const
+                {
+                        return WireCC::hashBytes(val.data(), val.size());
+                }
         };
 }
 
@@ -6,7 +6,11 @@
 #include <set>
 #include <cstring>
 #include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <cctype>
 #include <ctime>
+#include <thread>
 
 using namespace WireCC;
 
@@ -188,6 +192,1380 @@ void test_byte_buffer() {
     }
 }
 
+void test_byte_buffer_skip() {
+    std::cout << "\n=== Testing ByteBuffer skip ===" << std::endl;
+
+    ByteBuffer inner;
+    inner.writeUint(7);
+
+    ResourceSet rset;
+    rset.insert(2);
+    rset.insert(4);
+
+    ByteBuffer buffer;
+    buffer.writeString("skipped");
+    buffer.writeRset(rset);
+    buffer.writeBuffer(inner);
+    buffer.writeU64(1);
+    buffer.writeUint(2);
+    buffer.writeInt(-3);
+    buffer.writeBool(true);
+    buffer.writeString("third");
+
+    buffer.setPos(0);
+    buffer.skipString();
+    testAssert(buffer.getPos() == 4 + 7, "skipString advances past string");
+    buffer.skipRset();
+    testAssert(buffer.getPos() == 11 + 4 + 8, "skipRset advances past set");
+    buffer.skipBuffer();
+    buffer.skipU64();
+    buffer.skipUint();
+    buffer.skipInt();
+    buffer.skipBool();
+
+    std::string read_val;
+    buffer.readString(read_val);
+    testAssert(read_val == "third", "ByteBuffer reads field after skips");
+    testAssert(buffer.getPos() == buffer.size(), "ByteBuffer skips consume whole buffer");
+}
+
+void test_byte_view() {
+    std::cout << "\n=== Testing ByteView ===" << std::endl;
+
+    ResourceSet rset;
+    rset.insert(3);
+    rset.insert(9);
+
+    ByteBuffer inner;
+    inner.writeString("nested");
+
+    ByteBuffer buffer;
+    buffer.writeU64(0x0102030405060708ULL);
+    buffer.writeInt(-5);
+    buffer.writeBool(true);
+    buffer.writeString("view");
+    buffer.writeRset(rset);
+    buffer.writeBuffer(inner);
+
+    ByteView view = buffer.view();
+    uint64_t u64;
+    int i32;
+    bool flag;
+    std::string str;
+    ResourceSet read_set;
+    ByteView nested;
+    view.readU64(u64);
+    view.readInt(i32);
+    view.readBool(flag);
+    view.readString(str);
+    view.readRset(read_set);
+    view.readBuffer(nested);
+    testAssert(u64 == 0x0102030405060708ULL && i32 == -5 && flag, "ByteView reads scalars");
+    testAssert(str == "view" && read_set == rset, "ByteView reads string and ResourceSet");
+    testAssert(view.getPos() == view.size(), "ByteView consumes whole buffer");
+
+    std::string nested_str;
+    nested.readString(nested_str);
+    testAssert(nested_str == "nested", "ByteView reads nested buffer without copy");
+    testAssert(nested.data() == buffer.data() + buffer.size() - inner.size(),
+               "ByteView nested buffer points into source");
+}
+
+void test_table_layout() {
+    std::cout << "\n=== Testing TableWriter/TableReader ===" << std::endl;
+
+    ByteBuffer buffer;
+    buffer.writeUint(0xCAFE);
+    {
+        TableWriter table(buffer, 4);
+        table.field(0).writeString("first");
+        table.field(2).writeU64(42);
+        table.field(3).writeString("last");
+        table.finish();
+    }
+    buffer.writeUint(0xBEEF);
+
+    buffer.setPos(0);
+    unsigned int marker;
+    buffer.readUint(marker);
+    TableReader reader(buffer);
+    testAssert(reader.fieldCount() == 4, "TableReader field count");
+    testAssert(reader.hasField(0) && !reader.hasField(1) && reader.hasField(2),
+               "TableReader reports present fields");
+    testAssert(!reader.hasField(4), "TableReader out of range field absent");
+
+    ByteView last = reader.field(3);
+    std::string str;
+    last.readString(str);
+    testAssert(str == "last", "TableReader random access to last field");
+
+    ByteView middle = reader.field(2);
+    uint64_t val;
+    middle.readU64(val);
+    testAssert(val == 42 && middle.size() == 8, "TableReader field view bounds");
+
+    buffer.readUint(marker);
+    testAssert(marker == 0xBEEF, "TableReader advances buffer past message");
+}
+
+void test_varint() {
+    std::cout << "\n=== Testing Varint ===" << std::endl;
+
+    const uint64_t values[] = {0, 1, 127, 128, 300, 0xFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL};
+    const unsigned int sizes[] = {1, 1, 1, 2, 2, 5, 10};
+
+    ByteBuffer buffer;
+    bool sizes_ok = true;
+    for (unsigned int i = 0; i < 7; i++) {
+        unsigned int before = buffer.size();
+        buffer.writeVarint(values[i]);
+        sizes_ok = sizes_ok && (buffer.size() - before == sizes[i]) && (varintSize(values[i]) == sizes[i]);
+    }
+    testAssert(sizes_ok, "Varint encoded sizes");
+
+    buffer.setPos(0);
+    bool values_ok = true;
+    for (unsigned int i = 0; i < 7; i++) {
+        uint64_t val;
+        buffer.readVarint(val);
+        values_ok = values_ok && (val == values[i]);
+    }
+    testAssert(values_ok, "Varint roundtrip");
+
+    ByteView view = buffer.view();
+    for (unsigned int i = 0; i < 7; i++) {
+        view.skipVarint();
+    }
+    testAssert(view.getPos() == buffer.size(), "Varint skip");
+}
+
+struct TaggedMessage {
+    unsigned int id;
+    std::string name;
+};
+
+static void onTaggedId(TaggedMessage& msg, ByteView& value) {
+    value.readUint(msg.id);
+}
+
+static void onTaggedName(TaggedMessage& msg, ByteView& value) {
+    value.readString(msg.name);
+}
+
+void test_tagged_fields() {
+    std::cout << "\n=== Testing tagged fields ===" << std::endl;
+
+    ByteBuffer buffer;
+    unsigned int mark = buffer.beginTagged(2);
+    buffer.writeString("tagged");
+    buffer.endTagged(mark);
+    testAssert(buffer.size() == 1 + 5 + 4 + 6 && buffer.data()[1] == (0x80 | 10) && buffer.data()[5] == 0,
+               "Tagged field length patched in place");
+    mark = buffer.beginTagged(200);
+    for (int i = 0; i < 100; i++) {
+        buffer.writeU64(i);
+    }
+    buffer.endTagged(mark);
+    buffer.writeTag(1, 4);
+    buffer.writeUint(77);
+    testAssert(buffer.getPos() == buffer.size(), "Tagged fields position at end");
+
+    TagDispatcher<TaggedMessage> dispatcher;
+    dispatcher.on(1, onTaggedId);
+    dispatcher.on(2, onTaggedName);
+
+    TaggedMessage msg;
+    msg.id = 0;
+    buffer.setPos(0);
+    unsigned int unknown = dispatcher.dispatch(buffer, msg);
+    testAssert(msg.id == 77 && msg.name == "tagged", "TagDispatcher decodes known tags");
+    testAssert(unknown == 1, "TagDispatcher skips unknown tag");
+    testAssert(buffer.getPos() == buffer.size(), "TagDispatcher consumes buffer");
+
+    buffer.setPos(0);
+    unsigned int tag;
+    ByteView value;
+    buffer.readTagged(tag, value);
+    buffer.readTagged(tag, value);
+    testAssert(tag == 200 && value.size() == 800, "readTagged returns value view");
+}
+
+void test_shared_buffer() {
+    std::cout << "\n=== Testing SharedBuffer ===" << std::endl;
+
+    ByteBuffer buffer;
+    buffer.writeString("broadcast");
+    unsigned int size = buffer.size();
+    const uint8_t* bytes = buffer.data();
+
+    SharedBuffer shared = buffer.freeze();
+    testAssert(buffer.size() == 0 && buffer.getPos() == 0, "freeze clears ByteBuffer");
+    testAssert(shared.size() == size && shared.data() == bytes, "freeze does not copy bytes");
+
+    std::vector<SharedBuffer> queues(100, shared);
+    testAssert(shared.useCount() == 101, "SharedBuffer copies share bytes");
+    testAssert(queues[99].data() == bytes, "SharedBuffer copy points to same bytes");
+    queues.clear();
+    testAssert(shared.useCount() == 1, "SharedBuffer releases references");
+
+    ByteView view = shared.view();
+    std::string str;
+    view.readString(str);
+    testAssert(str == "broadcast", "SharedBuffer view decodes");
+
+    SharedBuffer empty;
+    testAssert(empty.size() == 0 && empty.data() == NULL, "Empty SharedBuffer");
+}
+
+void test_string_table() {
+    std::cout << "\n=== Testing StringTable ===" << std::endl;
+
+    StringTable encoder, decoder;
+    ByteBuffer buffer;
+    const std::string host = "storage-node-01.example.internal";
+    buffer.writeString(host, encoder);
+    unsigned int first_size = buffer.size();
+    buffer.writeString("tag", encoder);
+    buffer.writeString(host, encoder);
+    testAssert(buffer.size() - first_size == 1 + 1 + 3 + 1, "StringTable sends id on reuse");
+    testAssert(encoder.size() == 2, "StringTable encoder entries");
+
+    buffer.setPos(0);
+    ByteView first, second, third;
+    bool read_ok = buffer.readString(first, decoder);
+    read_ok = read_ok && buffer.readString(second, decoder);
+    read_ok = read_ok && buffer.readString(third, decoder);
+    testAssert(read_ok && first == ByteView((const uint8_t*) host.data(), host.size()) &&
+               std::string((const char*) second.data(), second.size()) == "tag" && third == first,
+               "StringTable roundtrip");
+    testAssert(decoder.size() == 2 && first.data() == (const uint8_t*) decoder.get(0)->data() &&
+               third.data() == first.data(), "StringTable returns views into the table");
+    testAssert(buffer.getPos() == buffer.size(), "StringTable consumes buffer");
+
+    // Full table falls back to literals
+    StringTable small_enc(1), small_dec(1);
+    buffer.clear();
+    buffer.writeString("a", small_enc);
+    buffer.writeString("b", small_enc);
+    buffer.writeString("b", small_enc);
+    buffer.writeString("a", small_enc);
+    ByteView view = buffer.view();
+    std::string a, b1, b2, a2;
+    view.readString(a, small_dec);
+    view.readString(b1, small_dec);
+    view.readString(b2, small_dec);
+    view.readString(a2, small_dec);
+    bool ok = a == "a" && b1 == "b" && b2 == "b" && a2 == "a";
+    testAssert(ok && buffer.size() == 3 + 3 + 3 + 1, "StringTable literals when full");
+
+    // Reference to an unknown id, definition out of order, definition past the
+    // table size and an unknown kind
+    const uint8_t bad_heads[][3] = {{5 << 2 | 0, 0, 0}, {1 << 2 | 1, 1, 'x'}, {1 << 2 | 1, 1, 'x'}, {3, 1, 'x'}};
+    bool rejected = true;
+    for (int i = 0; i < 4; i++) {
+        StringTable table(1), full(1);
+        ByteBuffer bad;
+        if (i == 2) {
+            bad.writeString("a", full);
+        }
+        bad.concat(bad_heads[i], sizeof(bad_heads[i]));
+        bad.setPos(0);
+        std::string str;
+        rejected = rejected && (i != 2 || bad.readString(str, table)) && !bad.readString(str, table);
+    }
+    testAssert(rejected, "StringTable rejects invalid ids");
+}
+
+void test_sorted_strings() {
+    std::cout << "\n=== Testing front-coded sorted strings ===" << std::endl;
+
+    std::vector<std::string> keys;
+    size_t raw_size = 0;
+    char name[64];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(name, sizeof(name), "/var/lib/wirecc/resources/%05d.dat", i * 2);
+        keys.push_back(name);
+        raw_size += 4 + keys.back().size();
+    }
+
+    ByteBuffer buffer;
+    buffer.writeSortedStrings(keys, 16);
+    buffer.writeUint(0xBEEF);
+    testAssert(buffer.size() < raw_size / 3, "Front coding shrinks sorted keys");
+
+    buffer.setPos(0);
+    std::vector<std::string> decoded;
+    testAssert(buffer.readSortedStrings(decoded) && decoded == keys, "readSortedStrings roundtrip");
+    unsigned int marker;
+    buffer.readUint(marker);
+    testAssert(marker == 0xBEEF, "readSortedStrings consumes list");
+
+    buffer.setPos(0);
+    SortedStringsReader reader(buffer);
+    buffer.readUint(marker);
+    testAssert(marker == 0xBEEF && reader.size() == 1000, "SortedStringsReader skips list");
+    testAssert(reader.get(0) == keys[0] && reader.get(999) == keys[999] && reader.get(517) == keys[517],
+               "SortedStringsReader random access");
+    testAssert(reader.contains(keys[0]) && reader.contains(keys[16]) && reader.contains(keys[733]),
+               "SortedStringsReader finds keys");
+    snprintf(name, sizeof(name), "/var/lib/wirecc/resources/%05d.dat", 733 * 2 + 1);
+    testAssert(!reader.contains(name), "SortedStringsReader rejects missing key");
+    testAssert(reader.lowerBound(name) == 734, "SortedStringsReader lowerBound between keys");
+    testAssert(reader.lowerBound("") == 0 && reader.lowerBound("~") == 1000,
+               "SortedStringsReader lowerBound at ends");
+
+    ByteBuffer empty;
+    empty.writeSortedStrings(std::vector<std::string>());
+    empty.setPos(0);
+    SortedStringsReader empty_reader(empty);
+    testAssert(empty_reader.size() == 0 && empty_reader.lowerBound("a") == 0 && !empty_reader.contains("a"),
+               "SortedStringsReader empty list");
+
+    ByteBuffer bad;
+    bad.writeUint(3);
+    bad.writeUint(0);
+    bad.writeUint(0);
+    bad.writeUint(0);
+    decoded.clear();
+    bad.setPos(0);
+    bool read_ok = bad.readSortedStrings(decoded);
+    bad.setPos(0);
+    SortedStringsReader bad_reader;
+    testAssert(!read_ok && decoded.empty() && !bad_reader.load(bad) && bad_reader.size() == 0,
+               "Sorted strings reject zero restart interval");
+
+    const uint8_t entries[] = {0, 1, 'a', 5, 1, 'b'};
+    bad.clear();
+    bad.writeUint(2);
+    bad.writeUint(16);
+    bad.writeUint(0);
+    bad.writeUint(sizeof(entries));
+    bad.concat(entries, sizeof(entries));
+    bad.setPos(0);
+    read_ok = bad.readSortedStrings(decoded);
+    bad.setPos(0);
+    testAssert(!read_ok && decoded.empty() && !bad_reader.load(bad) && bad_reader.size() == 0,
+               "Sorted strings reject overlong shared prefix");
+}
+
+void test_utf8_string() {
+    std::cout << "\n=== Testing UTF-8 validation ===" << std::endl;
+
+    std::string mixed;
+    for (int i = 0; i < 8; i++) {
+        mixed += "plain ascii text that spans several vector blocks, ";
+        mixed += "Gr\xC3\xBC\xC3\x9F" "e \xE6\x97\xA5\xE6\x9C\xAC \xF0\x9F\x98\x80 ";
+    }
+    testAssert(utf8Validate((const uint8_t*) mixed.data(), mixed.size()), "utf8Validate accepts mixed text");
+
+    const char* invalid[] = {
+        "\xC0\xAF",          // overlong
+        "\xED\xA0\x80",      // surrogate
+        "\xF4\x90\x80\x80",  // above U+10FFFF
+        "abc\xE6\x97",        // truncated
+        "\x80",              // stray continuation
+    };
+    bool rejected = true;
+    for (int i = 0; i < 5; i++) {
+        rejected = rejected && !utf8Validate((const uint8_t*) invalid[i], strlen(invalid[i]));
+    }
+    testAssert(rejected, "utf8Validate rejects invalid sequences");
+
+    bool positions_ok = true;
+    std::vector<uint8_t> copy(mixed.size());
+    for (size_t at = 0; at < 120; at++) {
+        std::string broken = mixed;
+        broken[at] = (char) 0xFF;
+        positions_ok = positions_ok && !utf8Validate((const uint8_t*) broken.data(), broken.size()) &&
+                       !utf8Copy((const uint8_t*) broken.data(), broken.size(), copy.data());
+        size_t len = mixed.size() - at;
+        positions_ok = positions_ok && utf8Copy((const uint8_t*) mixed.data() + at, len, copy.data()) ==
+                       utf8Validate((const uint8_t*) mixed.data() + at, len);
+    }
+    positions_ok = positions_ok && utf8Copy((const uint8_t*) mixed.data(), mixed.size(), copy.data()) &&
+                   memcmp(copy.data(), mixed.data(), mixed.size()) == 0;
+    testAssert(positions_ok, "UTF-8 checks catch errors at every block offset");
+
+    ByteBuffer buffer;
+    buffer.writeString(mixed);
+    std::string bad(40, 'x');
+    bad[33] = (char) 0xFF;
+    buffer.writeString(bad);
+    buffer.writeString("tail");
+
+    buffer.setPos(0);
+    std::string val;
+    testAssert(buffer.readUtf8String(val) && val == mixed, "readUtf8String accepts valid string");
+    val = "keep";
+    testAssert(!buffer.readUtf8String(val) && val == "keep", "readUtf8String rejects invalid string");
+    val.clear();
+    testAssert(buffer.readUtf8String(val) && val == "tail", "readUtf8String skips invalid string");
+}
+
+void test_packed_ints() {
+    std::cout << "\n=== Testing frame-of-reference bit packing ===" << std::endl;
+
+    std::vector<uint32_t> counters;
+    for (unsigned int i = 0; i < 1000; i++) {
+        counters.push_back(100000 + (i * 7919) % 1000);
+    }
+    ByteBuffer buffer;
+    buffer.writePackedUints(counters);
+    testAssert(buffer.size() < counters.size() * 2, "Packed small-range values use ~10 bits each");
+
+    std::vector<int> ids;
+    ids.push_back(-5);
+    ids.push_back(RESOURCE_INVALID);
+    ids.push_back(2147483647);
+    ids.push_back(-2147483647 - 1);
+    ids.push_back(0);
+    buffer.writePackedInts(ids);
+
+    std::vector<uint32_t> wide;
+    for (unsigned int i = 0; i < 300; i++) {
+        wide.push_back(i * 2654435761u);
+    }
+    buffer.writePackedUints(wide);
+    buffer.writePackedUints(std::vector<uint32_t>(130, 42));
+    buffer.writeUint(0xBEEF);
+
+    buffer.setPos(0);
+    std::vector<uint32_t> read_counters, read_wide, read_const;
+    std::vector<int> read_ids;
+    buffer.readPackedUints(read_counters);
+    buffer.readPackedInts(read_ids);
+    buffer.readPackedUints(read_wide);
+    buffer.readPackedUints(read_const);
+    unsigned int marker;
+    buffer.readUint(marker);
+    testAssert(read_counters == counters, "Packed uints roundtrip");
+    testAssert(read_ids == ids, "Packed ints roundtrip with full range");
+    testAssert(read_wide == wide, "Packed uints roundtrip with 32-bit width");
+    testAssert(read_const.size() == 130 && read_const[129] == 42, "Packed constant block uses zero width");
+    testAssert(marker == 0xBEEF, "Packed arrays consume buffer");
+
+    bool widths_ok = true;
+    uint32_t in[4 * 9], out[4 * 9];
+    uint8_t packed[16 * 9];
+    for (unsigned int width = 1; width <= 32; width++) {
+        for (unsigned int i = 0; i < 4 * 9; i++) {
+            in[i] = (width == 32 ? 0xFFFFFFFFu - i : ((1u << width) - 1) - (i % (1u << width)));
+        }
+        unsigned int written = bitPackLanes(in, 9, width, packed);
+        unsigned int read = bitUnpackLanes(packed, 9, width, out);
+        widths_ok = widths_ok && written == read && std::equal(in, in + 4 * 9, out);
+    }
+    testAssert(widths_ok, "bitPackLanes roundtrip for every width");
+}
+
+void test_elias_fano() {
+    std::cout << "\n=== Testing EliasFanoSet ===" << std::endl;
+
+    ResourceSet rset;
+    unsigned int seed = 12345;
+    while (rset.size() < 5000) {
+        seed = seed * 1103515245 + 12345;
+        rset.insert((int) (seed % 1000000) - 1000);
+    }
+
+    ByteBuffer buffer;
+    buffer.writeEliasFano(rset);
+    buffer.writeUint(0xBEEF);
+    testAssert(buffer.size() < rset.size() * 2, "Elias-Fano uses ~2 + log(u/n) bits per id");
+
+    buffer.setPos(0);
+    EliasFanoSet ef;
+    bool read_ok = buffer.readEliasFano(ef);
+    unsigned int marker;
+    buffer.readUint(marker);
+    testAssert(read_ok && marker == 0xBEEF && ef.size() == rset.size(), "Elias-Fano wire roundtrip size");
+
+    bool access_ok = true;
+    unsigned int i = 0;
+    for (ResourceSet::const_iterator itr = rset.begin(); itr != rset.end(); ++itr, ++i) {
+        access_ok = access_ok && ef.at(i) == *itr;
+    }
+    testAssert(access_ok, "Elias-Fano random access");
+
+    bool search_ok = true;
+    for (int probe = -2000; probe < 1000100; probe += 97) {
+        unsigned int expected = std::distance(rset.begin(), rset.lower_bound(probe));
+        search_ok = search_ok && ef.lowerBound(probe) == expected;
+        search_ok = search_ok && ef.contains(probe) == (rset.count(probe) > 0);
+    }
+    testAssert(search_ok, "Elias-Fano lowerBound and contains");
+
+    ResourceSet small;
+    small.insert(7);
+    EliasFanoSet single(small);
+    testAssert(single.size() == 1 && single.at(0) == 7 && single.contains(7) && !single.contains(8),
+               "Elias-Fano single id");
+    testAssert(single.lowerBound(8) == 1 && single.lowerBound(-3) == 0, "Elias-Fano single id lowerBound");
+
+    EliasFanoSet empty((ResourceSet()));
+    testAssert(empty.size() == 0 && !empty.contains(0), "Elias-Fano empty set");
+
+    ResourceSet dense;
+    for (int id = 100; id < 1100; id++) {
+        dense.insert(id);
+    }
+    EliasFanoSet dense_ef(dense);
+    testAssert(dense_ef.at(999) == 1099 && dense_ef.lowerBound(600) == 500 && !dense_ef.contains(1100),
+               "Elias-Fano dense set");
+
+    // count, lowBits, lower words, upper words and upper bits of each header
+    bool rejected = true;
+    uint64_t headers[][5] = {{2, 64, 2, 1, 3}, {2, 4, 0, 1, 3}, {2, 4, 1, 1, 7},
+                             {2, 4, 1, 0, 0}, {0, 1, 0, 1, 0}, {2, 0, 0, 1000, 3}};
+    for (int h = 0; h < 6; h++) {
+        ByteBuffer bad;
+        bad.writeUint(headers[h][0]);
+        bad.writeInt(0);
+        bad.writeUint(headers[h][1]);
+        bad.writeUint(headers[h][2]);
+        bad.writeUint(headers[h][3]);
+        for (uint64_t w = 0; w < headers[h][2]; w++) {
+            bad.writeU64(0);
+        }
+        for (uint64_t w = 0; w < headers[h][3] && w < 2; w++) {
+            bad.writeU64(headers[h][4]);
+        }
+        bad.setPos(0);
+        rejected = rejected && !bad.readEliasFano(ef);
+    }
+    testAssert(rejected && ef.size() == rset.size() && ef.at(17) == *std::next(rset.begin(), 17),
+               "Elias-Fano rejects inconsistent headers");
+}
+
+void test_bit_stream() {
+    std::cout << "\n=== Testing BitWriter/BitReader ===" << std::endl;
+
+    BitWriter bits;
+    for (int i = 0; i < 100; i++) {
+        bits.writeBit(i % 3 == 0);
+    }
+    for (unsigned int i = 0; i < 40; i++) {
+        bits.writeBits(i % 8, 3);
+    }
+    bits.writeBits(0x123456789ABCDEF0ULL, 64);
+    bits.writeBits(0x1FFFFFFFFFFFFFFULL, 57);
+    bits.writeBits(5, 0);
+    bits.writeBits(0xFFFF, 5);
+    testAssert(bits.bitCount() == 100 + 120 + 64 + 57 + 5, "BitWriter bit count");
+    testAssert(bits.size() == (bits.bitCount() + 7) / 8, "BitWriter size in bytes");
+
+    ByteBuffer buffer;
+    buffer.writeUint(0xCAFE);
+    buffer.writeBits(bits);
+    buffer.writeUint(0xBEEF);
+    testAssert(buffer.size() == 4 + 4 + 44 + 4, "Flags take a bit each in ByteBuffer");
+
+    buffer.setPos(0);
+    unsigned int marker;
+    buffer.readUint(marker);
+    BitReader reader;
+    buffer.readBits(reader);
+    bool flags_ok = true;
+    for (int i = 0; i < 100; i++) {
+        flags_ok = flags_ok && reader.readBit() == (i % 3 == 0);
+    }
+    testAssert(flags_ok, "BitReader reads packed flags");
+    bool fields_ok = true;
+    for (unsigned int i = 0; i < 40; i++) {
+        fields_ok = fields_ok && reader.readBits(3) == i % 8;
+    }
+    testAssert(fields_ok, "BitReader reads 3-bit fields");
+    testAssert(reader.readBits(64) == 0x123456789ABCDEF0ULL, "BitReader reads 64-bit field");
+    testAssert(reader.readBits(57) == 0x1FFFFFFFFFFFFFFULL, "BitReader reads 57-bit field");
+    testAssert(reader.readBits(0) == 0 && reader.readBits(5) == 0x1F, "BitReader reads tail field");
+    testAssert(reader.getBitPos() == bits.bitCount(), "BitReader position");
+    buffer.readUint(marker);
+    testAssert(marker == 0xBEEF, "ByteBuffer readBits skips stream");
+}
+
+void test_float_arrays() {
+    std::cout << "\n=== Testing float array precisions ===" << std::endl;
+
+    testAssert(floatToHalf(1.0f) == 0x3C00 && floatToHalf(-2.0f) == 0xC000, "floatToHalf normal values");
+    testAssert(floatToHalf(65504.0f) == 0x7BFF && floatToHalf(1e6f) == 0x7C00, "floatToHalf max and overflow");
+    testAssert(floatToHalf(5.9604645e-8f) == 0x0001 && halfToFloat(0x0001) == 5.9604645e-8f,
+               "Half subnormal roundtrip");
+    testAssert(halfToFloat(0x3555) == 0.333251953125f, "halfToFloat exact value");
+    testAssert(floatToBfloat16(1.0f) == 0x3F80 && bfloat16ToFloat(0x3F80) == 1.0f, "bfloat16 conversion");
+
+    bool all_halves = true;
+    for (unsigned int h = 0; h < 0x10000; h++) {
+        if ((h & 0x7C00) == 0x7C00 && (h & 0x3FF) != 0) {
+            continue;  // NaN payloads
+        }
+        all_halves = all_halves && floatToHalf(halfToFloat(h)) == h;
+    }
+    testAssert(all_halves, "Every half value roundtrips through float");
+
+    std::vector<double> features;
+    for (int i = 0; i < 1000; i++) {
+        features.push_back(std::sin(i * 0.01) * 3.0);
+    }
+
+    const FloatPrecision precisions[] = {FLOAT_64, FLOAT_32, FLOAT_16, BFLOAT_16, QUANT_16, QUANT_8};
+    const double tolerances[] = {0.0, 1e-6, 2e-3, 2e-2, 1e-4, 2e-2};
+    const unsigned int widths[] = {8, 4, 2, 2, 2, 1};
+    ByteBuffer buffer;
+    for (int p = 0; p < 6; p++) {
+        buffer.writeFloatArray(features, precisions[p]);
+    }
+    buffer.setPos(0);
+    for (int p = 0; p < 6; p++) {
+        unsigned int start = buffer.getPos();
+        std::vector<double> read;
+        buffer.readFloatArray(read);
+        double err = 0;
+        for (size_t i = 0; i < features.size(); i++) {
+            err = std::max(err, std::fabs(read[i] - features[i]));
+        }
+        unsigned int header = 5 + (p >= 4 ? 16 : 0);
+        testAssert(read.size() == features.size() && err <= tolerances[p], "Float array within precision");
+        testAssert(buffer.getPos() - start == header + widths[p] * features.size(), "Float array wire size");
+    }
+
+    std::vector<double> constant(10, 4.5);
+    buffer.clear();
+    buffer.writeFloatArray(constant, QUANT_8);
+    buffer.writeFloatArray(std::vector<double>(), FLOAT_16);
+    buffer.setPos(0);
+    std::vector<double> read;
+    buffer.readFloatArray(read);
+    testAssert(read == constant, "Quantized constant array is exact");
+    buffer.readFloatArray(read);
+    testAssert(read.size() == 10 && buffer.getPos() == buffer.size(), "Empty float array");
+}
+
+void test_text_transcoding() {
+    std::cout << "\n=== Testing hex and base64 transcoding ===" << std::endl;
+
+    ByteBuffer buffer;
+    buffer.writeString("foobar");
+    testAssert(buffer.toHex() == "00000006666f6f626172", "ByteBuffer toHex");
+    ByteView tail(buffer.data() + 4, 6);
+    testAssert(tail.toBase64() == "Zm9vYmFy", "ByteView toBase64");
+
+    const char* plain[] = {"", "f", "fo", "foo", "foob", "fooba", "foobar"};
+    const char* encoded[] = {"", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy"};
+    bool vectors_ok = true;
+    for (int i = 0; i < 7; i++) {
+        ByteView v((const uint8_t*) plain[i], strlen(plain[i]));
+        ByteBuffer decoded;
+        vectors_ok = vectors_ok && v.toBase64() == encoded[i];
+        vectors_ok = vectors_ok && decoded.loadBase64(encoded[i]) && decoded.size() == strlen(plain[i]) &&
+                     (decoded.size() == 0 || memcmp(decoded.data(), plain[i], decoded.size()) == 0);
+    }
+    testAssert(vectors_ok, "Base64 test vectors");
+
+    std::vector<uint8_t> bytes;
+    unsigned int seed = 99;
+    for (int i = 0; i < 1000; i++) {
+        seed = seed * 1103515245 + 12345;
+        bytes.push_back(seed >> 16);
+    }
+    bool roundtrip_ok = true;
+    for (unsigned int len = 0; len < bytes.size(); len += (len < 100 ? 1 : 37)) {
+        ByteBuffer original, from_hex, from_b64;
+        original.load(bytes.data(), len);
+        std::string hex = original.toHex();
+        std::string upper = hex;
+        for (size_t i = 0; i < upper.size(); i++) {
+            upper[i] = toupper(upper[i]);
+        }
+        roundtrip_ok = roundtrip_ok && hex.size() == 2 * len;
+        roundtrip_ok = roundtrip_ok && from_hex.loadHex(upper) && from_hex.size() == len &&
+                       std::equal(bytes.begin(), bytes.begin() + len, from_hex.data());
+        std::string b64 = original.toBase64();
+        roundtrip_ok = roundtrip_ok && b64.size() == base64Size(len);
+        roundtrip_ok = roundtrip_ok && from_b64.loadBase64(b64) && from_b64.size() == len &&
+                       std::equal(bytes.begin(), bytes.begin() + len, from_b64.data());
+        for (unsigned int i = 0; i < len; i++) {
+            char expect[3];
+            snprintf(expect, sizeof(expect), "%02x", bytes[i]);
+            roundtrip_ok = roundtrip_ok && hex.compare(2 * i, 2, expect) == 0;
+        }
+    }
+    testAssert(roundtrip_ok, "Hex and base64 roundtrip at every length");
+
+    ByteBuffer invalid;
+    std::string long_hex(64, 'a');
+    long_hex[40] = 'g';
+    std::string long_b64(64, 'A');
+    long_b64[20] = '*';
+    testAssert(!invalid.loadHex("abc") && !invalid.loadHex("zz") && !invalid.loadHex(long_hex),
+               "loadHex rejects invalid text");
+    testAssert(!invalid.loadBase64("Zg=") && !invalid.loadBase64("Z===") && !invalid.loadBase64("Zg==Zg==") &&
+               !invalid.loadBase64(long_b64), "loadBase64 rejects invalid text");
+    testAssert(invalid.size() == 0, "Invalid text leaves buffer cleared");
+}
+
+void test_hash() {
+    std::cout << "\n=== Testing hashing ===" << std::endl;
+
+    const char* spam = "Nobody inspects the spammish repetition";
+    testAssert(hashBytes(NULL, 0) == 0xEF46DB3751D8E999ULL, "Hash of empty input");
+    testAssert(hashBytes((const uint8_t*) "abc", 3) == 0x44BC2CF5AD770999ULL, "Hash of short input");
+    testAssert(hashBytes((const uint8_t*) spam, strlen(spam)) == 0xFBCEA83C8A378BF1ULL, "Hash of striped input");
+    testAssert(hashBytes((const uint8_t*) "abc", 3, 1) != hashBytes((const uint8_t*) "abc", 3), "Seed changes hash");
+
+    std::vector<uint8_t> bytes;
+    unsigned int seed = 7;
+    for (int i = 0; i < 300; i++) {
+        seed = seed * 1103515245 + 12345;
+        bytes.push_back(seed >> 16);
+    }
+    bool streaming_ok = true;
+    for (size_t len = 0; len <= bytes.size(); len += 13) {
+        uint64_t expected = hashBytes(bytes.data(), len, 42);
+        for (size_t chunk = 1; chunk < 70; chunk += 5) {
+            Hasher hasher(42);
+            for (size_t pos = 0; pos < len; pos += chunk) {
+                hasher.update(bytes.data() + pos, std::min(chunk, len - pos));
+            }
+            streaming_ok = streaming_ok && hasher.digest() == expected;
+        }
+    }
+    testAssert(streaming_ok, "Incremental hash matches one-shot hash");
+
+    ByteBuffer buffer;
+    Hasher hasher;
+    unsigned int mark = 0;
+    for (int i = 0; i < 20; i++) {
+        buffer.writeUint(i * 1000);
+        buffer.writeString("field");
+        hasher.update(buffer, mark);
+    }
+    testAssert(mark == buffer.size(), "Hash mark follows buffer end");
+    testAssert(hasher.digest() == hashBytes(buffer.data(), buffer.size()), "Hash fed while writing");
+
+    ByteBuffer copy;
+    copy.load(buffer.data(), buffer.size());
+    ByteView view = buffer.view();
+    testAssert(copy == buffer && view == copy.view(), "Buffers and views compare by content");
+    testAssert(std::hash<ByteBuffer>()(copy) == std::hash<ByteBuffer>()(buffer) &&
+               std::hash<ByteView>()(view) == std::hash<ByteBuffer>()(buffer), "std::hash of equal bytes");
+    copy.writeBool(true);
+    testAssert(!(copy == buffer), "Buffers with different bytes differ");
+}
+
+void test_encode_cache() {
+    std::cout << "\n=== Testing EncodeCache ===" << std::endl;
+
+    EncodeCache cache(64);
+    ResourceSet big;
+    for (ResourceId i = 0; i < 5; i++) {
+        big.insert(i * 7);
+    }
+    int encodes = 0;
+    auto encodeBig = [&](ByteBuffer& out) { encodes++; out.writeRset(big); };
+
+    ByteBuffer first, second;
+    testAssert(!cache.splice(first, &big, 1, encodeBig), "First splice misses");
+    testAssert(cache.splice(second, &big, 1, encodeBig), "Second splice hits");
+    testAssert(encodes == 1 && first == second, "Cached bytes match encoding");
+    testAssert(cache.size() == 1 && cache.bytes() == first.size(), "Cache accounts stored bytes");
+
+    big.insert(100);
+    ByteBuffer third;
+    testAssert(!cache.splice(third, &big, 2, encodeBig), "New version misses");
+    testAssert(encodes == 2 && cache.size() == 1 && !(third == first), "New version replaces old entry");
+    ResourceSet decoded;
+    third.setPos(0);
+    third.readRset(decoded);
+    testAssert(decoded == big, "Spliced bytes decode");
+
+    SharedBuffer segment;
+    testAssert(cache.lookup(&big, 2, segment) && segment.size() == third.size(), "Lookup returns segment");
+    testAssert(!cache.lookup(&big, 1, segment), "Stale version misses");
+    testAssert(cache.hits() == 2 && cache.misses() == 3 && cache.hitRate() == 0.4, "Hit and miss counters");
+
+    int objs[4];
+    std::vector<uint8_t> blob(20, 0xab);
+    for (int i = 0; i < 4; i++) {
+        std::vector<uint8_t> tmp = blob;
+        cache.store(&objs[i], 0, SharedBuffer(tmp));
+        cache.lookup(&objs[0], 0, segment);
+    }
+    testAssert(cache.bytes() <= 64, "Cache stays within budget");
+    testAssert(cache.lookup(&objs[0], 0, segment) && cache.lookup(&objs[3], 0, segment),
+               "Recently used entries survive");
+    testAssert(!cache.lookup(&big, 2, segment) && !cache.lookup(&objs[1], 0, segment),
+               "Least recently used entries are evicted");
+
+    std::vector<uint8_t> huge(100, 1);
+    cache.store(&huge, 0, SharedBuffer(huge));
+    testAssert(!cache.lookup(&huge, 0, segment) && cache.bytes() <= 64, "Oversized bytes are not cached");
+    cache.clear();
+    testAssert(cache.size() == 0 && cache.bytes() == 0 && cache.hits() == 0, "Clear empties the cache");
+}
+
+void test_resource_set_pool() {
+    std::cout << "\n=== Testing ResourceSetPool ===" << std::endl;
+
+    ResourceSetPool pool;
+    ResourceSet a, b;
+    for (ResourceId i = 10; i > -5; i--) {
+        a.insert(i * 3);
+        b.insert(i * 3);
+    }
+    SharedResourceSet sa = pool.intern(a);
+    SharedResourceSet sb = pool.intern(b);
+    testAssert(sa == sb && pool.size() == 1, "Equal sets share one instance");
+    testAssert(std::equal(a.begin(), a.end(), sa->begin()) && sa->size() == a.size(), "Interned set holds ids");
+
+    FlatResourceSet unsorted;
+    unsorted.push_back(30);
+    unsorted.push_back(-12);
+    unsorted.push_back(30);
+    unsorted.push_back(0);
+    SharedResourceSet sc = pool.intern(unsorted);
+    testAssert(sc != sa && pool.size() == 2, "Different sets get different instances");
+    testAssert(unsorted.size() == 3 && unsorted[0] == -12 && unsorted[2] == 30, "Flat sets are normalized");
+
+    ByteBuffer buffer;
+    buffer.writeRset(a);
+    buffer.writeRset(*sc);
+    buffer.writeRset(ResourceSet());
+    SharedResourceSet r1, r2, r3;
+    buffer.setPos(0);
+    buffer.readRset(pool, r1);
+    buffer.readRset(pool, r2);
+    buffer.readRset(pool, r3);
+    testAssert(r1 == sa && r2 == sc && r3->empty(), "ByteBuffer readRset interns decoded sets");
+    ByteView view = buffer.view();
+    SharedResourceSet v1;
+    view.readRset(pool, v1);
+    testAssert(v1 == sa, "ByteView readRset interns decoded sets");
+    ResourceSet plain;
+    buffer.setPos(0);
+    buffer.skipRset();
+    buffer.readRset(plain);
+    testAssert(plain.size() == 3 && *plain.begin() == -12, "Flat set wire format matches ResourceSet");
+
+    int count = 0;
+    for (FlatResourceIterator itr(*sa); itr.current != itr.end; ++itr.current) {
+        count++;
+    }
+    testAssert(count == (int) a.size(), "FlatResourceIterator visits all ids");
+
+    sb.reset();
+    r2.reset();
+    sc.reset();
+    r3.reset();
+    testAssert(pool.purge() == 2 && pool.size() == 1, "Purge drops unreferenced sets");
+    testAssert(pool.intern(a) == sa, "Referenced sets survive purge");
+}
+
+void test_persistent_resource_set() {
+    std::cout << "\n=== Testing PersistentResourceSet ===" << std::endl;
+
+    ResourceSet initial;
+    for (ResourceId i = -50; i < 150; i += 2) {
+        initial.insert(i);
+    }
+    PersistentResourceSet pset(initial);
+    testAssert(pset.size() == initial.size() && std::equal(initial.begin(), initial.end(), pset.begin()),
+               "Persistent set built from ResourceSet");
+
+    PersistentResourceSet snapshot = pset;
+    ResourceSet model = initial;
+    unsigned int seed = 12345;
+    bool ops_ok = true;
+    for (int i = 0; i < 2000; i++) {
+        seed = seed * 1103515245 + 12345;
+        ResourceId id = (ResourceId) ((seed >> 16) % 400) - 100;
+        if (seed & 0x100) {
+            ops_ok = ops_ok && pset.insert(id) == model.insert(id).second;
+        } else {
+            ops_ok = ops_ok && pset.erase(id) == (model.erase(id) == 1);
+        }
+        ops_ok = ops_ok && pset.contains(id) == (model.count(id) == 1);
+    }
+    testAssert(ops_ok, "Insert and erase match std::set");
+    testAssert(pset.size() == model.size() && std::equal(model.begin(), model.end(), pset.begin()),
+               "Persistent set iterates in order");
+    testAssert(snapshot.size() == initial.size() && std::equal(initial.begin(), initial.end(), snapshot.begin()),
+               "Snapshot is unaffected by later updates");
+
+    int count = 0;
+    ResourceId prev = RESOURCE_INVALID;
+    bool ordered = true;
+    for (PersistentResourceIterator itr(pset); itr.current != itr.end; ++itr.current) {
+        ordered = ordered && (count == 0 || *itr.current > prev);
+        prev = *itr.current;
+        count++;
+    }
+    testAssert(ordered && count == (int) pset.size(), "PersistentResourceIterator visits all ids");
+
+    PersistentResourceSet copy = snapshot;
+    copy = pset;
+    bool copy_ok = true;
+    for (ResourceId i = 299; i >= -100; i--) {
+        copy_ok = copy_ok && copy.insert(i) == (model.count(i) == 0);
+    }
+    ResourceId next = -100;
+    for (PersistentResourceSet::const_iterator itr = copy.begin(); itr != copy.end() && copy_ok; ++itr) {
+        copy_ok = (*itr == next++);
+    }
+    testAssert(copy_ok && next == 300 && copy.size() == 400 && pset.size() == model.size(),
+               "Assigned copy keeps updating in order");
+
+    ByteBuffer buffer;
+    buffer.writeRset(pset);
+    ResourceSet decoded;
+    PersistentResourceSet pdecoded, vdecoded;
+    buffer.setPos(0);
+    buffer.readRset(decoded);
+    buffer.setPos(0);
+    buffer.readRset(pdecoded);
+    ByteView view = buffer.view();
+    view.readRset(vdecoded);
+    testAssert(decoded == model, "Persistent set uses ResourceSet wire format");
+    testAssert(std::equal(model.begin(), model.end(), pdecoded.begin()) && pdecoded.size() == model.size() &&
+               vdecoded.size() == model.size(), "Persistent set decodes");
+
+    PersistentResourceSet empty;
+    testAssert(empty.begin() == empty.end() && !empty.erase(1) && empty.insert(1) && empty.contains(1),
+               "Empty persistent set");
+    empty.clear();
+    testAssert(empty.empty() && !empty.contains(1), "Cleared persistent set");
+}
+
+struct CountedSet {
+    static int live;
+    ResourceSet ids;
+    CountedSet() { live++; }
+    ~CountedSet() { live--; }
+};
+int CountedSet::live = 0;
+
+void test_epoch_reclamation() {
+    std::cout << "\n=== Testing epoch-based reclamation ===" << std::endl;
+
+    typedef std::map<ResourceId, CountedSet*> CountedMap;
+    {
+        EpochManager epochs(4);
+        unsigned int reader = 99;
+        testAssert(epochs.registerReader(reader) && reader == 0, "Reader registers a slot");
+        Published<CountedMap> published(epochs, new CountedMap(), deleteWithValues<CountedMap>);
+
+        CountedMap* v1 = new CountedMap();
+        (*v1)[1] = new CountedSet();
+        (*v1)[1]->ids.insert(10);
+        (*v1)[1]->ids.insert(20);
+        published.publish(v1);
+        epochs.collect();
+
+        epochs.enter(reader);
+        const CountedMap* seen = published.get();
+        CountedMap::const_iterator found = seen->find(1);
+        ResourceIterator itr(found->second->ids);
+
+        CountedMap* v2 = new CountedMap();
+        (*v2)[1] = new CountedSet();
+        published.publish(v2);
+        epochs.collect();
+        testAssert(CountedSet::live == 2 && epochs.pending() == 1, "Version seen by reader is kept");
+        int count = 0;
+        for (; itr.current != itr.end; ++itr.current) {
+            count++;
+        }
+        testAssert(count == 2, "Reader iterates its snapshot after publish");
+        epochs.exit(reader);
+
+        testAssert(epochs.collect() == 1 && CountedSet::live == 1 && epochs.pending() == 0,
+                   "Version is reclaimed after reader exits");
+        {
+            EpochManager::Guard guard(epochs, reader);
+            testAssert(published.get() == v2, "Reader sees latest version");
+            published.publish(new CountedMap());
+        }
+        testAssert(epochs.collect() == 1 && CountedSet::live == 0, "Guard releases epoch");
+        epochs.unregisterReader(reader);
+    }
+    testAssert(CountedSet::live == 0, "Published versions are destroyed");
+
+    typedef std::map<ResourceId, ResourceSet> RsetMap;
+    EpochManager epochs(8);
+    Published<RsetMap> published(epochs, new RsetMap());
+    std::atomic<bool> done(false);
+    std::atomic<int> bad(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.push_back(std::thread([&]() {
+            unsigned int slot;
+            if (!epochs.registerReader(slot)) {
+                bad++;
+                return;
+            }
+            while (!done.load()) {
+                EpochManager::Guard guard(epochs, slot);
+                const RsetMap* map = published.get();
+                for (ResourceId rid = 0; rid < 4; rid++) {
+                    ResourceIterator itr = getIteratorFromMap(*map, rid);
+                    unsigned int seen = 0;
+                    for (; itr.current != itr.end; ++itr.current) {
+                        seen += (*itr.current == rid) ? 1 : 0;
+                    }
+                    if (map->count(rid) && seen != 1) {
+                        bad++;
+                    }
+                }
+            }
+            epochs.unregisterReader(slot);
+        }));
+    }
+    for (int version = 0; version < 500; version++) {
+        RsetMap* next = new RsetMap();
+        for (ResourceId rid = 0; rid < 4; rid++) {
+            (*next)[rid].insert(rid);
+            (*next)[rid].insert(rid + 100 + version);
+        }
+        published.publish(next);
+        epochs.collect();
+    }
+    done.store(true);
+    for (size_t t = 0; t < readers.size(); t++) {
+        readers[t].join();
+    }
+    epochs.collect();
+    testAssert(bad.load() == 0, "Concurrent readers see consistent versions");
+    testAssert(epochs.pending() == 0, "Concurrent retired versions are reclaimed");
+}
+
+void test_sharded_map() {
+    std::cout << "\n=== Testing ShardedMap ===" << std::endl;
+
+    ShardedMap<> map(6);
+    testAssert(map.shardCount() == 8, "Shard count rounds up to a power of two");
+    ResourceSet ids;
+    ids.insert(3);
+    ids.insert(5);
+    testAssert(map.insert(1, ids) && !map.insert(1, ResourceSet()), "Insert adds missing ids only");
+    map.update(2, [](ResourceSet& val) { val.insert(7); });
+    unsigned int walked = 0;
+    testAssert(map.visit(1, [&walked](const ResourceSet& val) {
+        for (ResourceIterator itr(val); itr.current != itr.end; ++itr.current) {
+            walked++;
+        }
+    }) && walked == 2, "Visit iterates the value under its lock");
+    ResourceSet copy;
+    testAssert(map.get(2, copy) && copy.size() == 1 && *copy.begin() == 7, "Update creates missing values");
+    testAssert(!map.visit(9, [](const ResourceSet&) {}) && !map.get(9, copy), "Missing ids are not visited");
+    map.assign(1, ResourceSet());
+    testAssert(map.get(1, copy) && copy.empty() && map.size() == 2, "Assign replaces values");
+    testAssert(map.erase(1) && !map.erase(1) && !map.contains(1) && map.contains(2), "Erase removes ids");
+    map.clear();
+    testAssert(map.size() == 0, "Clear empties all shards");
+
+    ShardedMap<> shared;
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; t++) {
+        writers.push_back(std::thread([&shared, t]() {
+            for (ResourceId rid = 0; rid < 1000; rid++) {
+                shared.update(rid, [t](ResourceSet& val) { val.insert(t); });
+                shared.visit(rid / 2, [](const ResourceSet& val) { (void) val.size(); });
+            }
+        }));
+    }
+    for (size_t t = 0; t < writers.size(); t++) {
+        writers[t].join();
+    }
+    bool complete = shared.size() == 1000;
+    for (ResourceId rid = 0; rid < 1000; rid++) {
+        complete = complete && shared.visit(rid, [&complete](const ResourceSet& val) {
+            complete = complete && val.size() == 4;
+        });
+    }
+    testAssert(complete, "Concurrent updates are all applied");
+}
+
+void test_radix_sort() {
+    std::cout << "\n=== Testing radix sort of ResourceIds ===" << std::endl;
+
+    unsigned int seed = 4242;
+    size_t sizes[] = {0, 1, 100, 300, 5000, 300000};
+    bool sorted_ok = true;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (unsigned int threads = 1; threads <= 4; threads += 3) {
+            FlatResourceSet ids;
+            ResourceSet expected;
+            for (size_t i = 0; i < sizes[s]; i++) {
+                seed = seed * 1103515245 + 12345;
+                ResourceId id = (ResourceId) (seed ^ (seed << 7));
+                if (i % 3 == 0) {
+                    id = (ResourceId) (seed >> 20) - 2048;
+                }
+                ids.push_back(id);
+                expected.insert(id);
+            }
+            ids.push_back(RESOURCE_INVALID);
+            ids.push_back(RESOURCE_INVALID);
+            expected.insert(RESOURCE_INVALID);
+            ResourceSet built;
+            built.insert(123456789);
+            FlatResourceSet copy = ids;
+            buildResourceSet(ids, built, threads);
+            sortResourceIds(copy, threads);
+            sorted_ok = sorted_ok && built == expected && copy.size() == expected.size() &&
+                        std::equal(expected.begin(), expected.end(), copy.begin());
+        }
+    }
+    testAssert(sorted_ok, "Radix sort matches std::set");
+
+    FlatResourceSet narrow;
+    for (ResourceId i = 999; i >= 0; i--) {
+        narrow.push_back(i % 500);
+    }
+    sortResourceIds(narrow);
+    testAssert(narrow.size() == 500 && narrow.front() == 0 && narrow.back() == 499,
+               "Radix sort skips trivial passes");
+    FlatResourceSet extremes;
+    for (int i = 0; i < 300; i++) {
+        extremes.push_back(i % 2 ? INT32_MIN + i : INT32_MAX - i);
+    }
+    sortResourceIds(extremes);
+    testAssert(extremes.front() == INT32_MIN + 1 && extremes.back() == INT32_MAX &&
+               std::is_sorted(extremes.begin(), extremes.end()), "Radix sort orders signed ids");
+}
+
+void test_bloom_filter() {
+    std::cout << "\n=== Testing BloomFilter ===" << std::endl;
+
+    BloomFilter empty;
+    testAssert(!empty.contains(1) && empty.blockCount() == 0, "Empty filter contains nothing");
+    empty.insert(1);
+    testAssert(!empty.contains(1) && empty.blockCount() == 0, "Empty filter ignores inserts");
+
+    BloomFilter filter(10000, 0.01);
+    FlatResourceSet ids;
+    for (ResourceId i = 0; i < 10000; i++) {
+        ids.push_back(i * 7919 - 30000);
+    }
+    filter.insertAll(ids);
+    bool no_false_negatives = true;
+    for (size_t i = 0; i < ids.size(); i++) {
+        no_false_negatives = no_false_negatives && filter.contains(ids[i]);
+    }
+    testAssert(no_false_negatives, "Bloom filter has no false negatives");
+    int false_positives = 0;
+    for (ResourceId i = 0; i < 100000; i++) {
+        false_positives += filter.contains(i * 7919 - 30000 + 1) ? 1 : 0;
+    }
+    testAssert(false_positives < 1500, "Bloom filter false-positive rate near target");
+    testAssert(BloomFilter::estimateFpr(10000, filter.blockCount()) <= 0.01 &&
+               filter.blockCount() * 32 < 10000 * 2, "Bloom filter sized for target rate");
+
+    ByteBuffer buffer;
+    buffer.writeBloom(filter);
+    testAssert(buffer.size() == 4 + filter.blockCount() * 32, "Bloom filter wire size");
+    BloomFilter decoded;
+    buffer.setPos(0);
+    bool read_ok = buffer.readBloom(decoded);
+    bool same = read_ok && decoded.blockCount() == filter.blockCount();
+    for (ResourceId i = -50000; i < 50000 && same; i += 3) {
+        same = decoded.contains(i) == filter.contains(i);
+    }
+    testAssert(same, "Bloom filter roundtrip");
+
+    ResourceSet absent, present;
+    absent.insert(-1);
+    absent.insert(-2);
+    present.insert(-1);
+    present.insert(ids[5]);
+    BloomFilter other(10000, 0.01);
+    other.insert(-1);
+    testAssert(!filter.containsAny(absent) && filter.containsAny(present), "Bloom filter containsAny");
+    testAssert(filter.merge(other) && filter.contains(-1), "Bloom filter merge");
+    testAssert(!filter.merge(BloomFilter(10, 0.5)), "Bloom filter merge rejects different sizes");
+    filter.clear();
+    testAssert(!filter.contains(ids[0]) && filter.blockCount() == decoded.blockCount(), "Bloom filter clear");
+
+    buffer.clear();
+    buffer.writeUint(0);
+    buffer.setPos(0);
+    testAssert(!buffer.readBloom(decoded) && decoded.blockCount() == filter.blockCount(), "Bloom filter rejects zero blocks");
+}
+
+void test_hyperloglog() {
+    std::cout << "\n=== Testing HyperLogLog ===" << std::endl;
+
+    HyperLogLog empty;
+    testAssert(empty.estimate() == 0 && empty.isSparse(), "Empty sketch estimates zero");
+
+    HyperLogLog small;
+    for (ResourceId i = 0; i < 500; i++) {
+        small.add(i * 13);
+        small.add(i * 13);
+    }
+    testAssert(small.isSparse() && std::fabs(small.estimate() - 500) < 10, "Sparse sketch is near exact");
+
+    HyperLogLog big, left, right;
+    for (ResourceId i = 0; i < 200000; i++) {
+        big.add(i - 100000);
+        (i % 2 ? left : right).add(i - 100000);
+    }
+    testAssert(!big.isSparse() && std::fabs(big.estimate() - 200000) < 200000 * 0.03,
+               "Dense sketch estimate within error");
+    testAssert(left.merge(right) && left.estimate() == big.estimate(), "Merged sketch matches single sketch");
+
+    HyperLogLog sparse_a, sparse_b;
+    for (ResourceId i = 0; i < 300; i++) {
+        sparse_a.add(i);
+        sparse_b.add(i + 150);
+    }
+    testAssert(sparse_a.merge(sparse_b) && sparse_a.isSparse() && std::fabs(sparse_a.estimate() - 450) < 10,
+               "Sparse sketches merge");
+    HyperLogLog mixed = big;
+    testAssert(mixed.merge(sparse_a) && std::fabs(mixed.estimate() - big.estimate()) < 1000,
+               "Sparse sketch merges into dense sketch");
+    testAssert(!mixed.merge(HyperLogLog(10)), "Merge rejects different precisions");
+
+    ByteBuffer buffer;
+    buffer.writeHyperLogLog(small);
+    buffer.writeHyperLogLog(big);
+    HyperLogLog small_decoded, big_decoded(4);
+    buffer.setPos(0);
+    bool read_ok = buffer.readHyperLogLog(small_decoded);
+    read_ok = read_ok && buffer.readHyperLogLog(big_decoded);
+    testAssert(read_ok && small_decoded.isSparse() && small_decoded.estimate() == small.estimate() &&
+               buffer.getPos() == buffer.size() && big_decoded.precision() == 14 &&
+               big_decoded.estimate() == big.estimate(), "HyperLogLog roundtrip");
+
+    // Precision out of range, then sparse entries out of order, with a zero
+    // rank, with a rank above 64 - 14 + 1 and with an index past 2^14
+    bool rejected = true;
+    const uint8_t precisions[] = {0, 1, 19, 32};
+    for (int i = 0; i < 4; i++) {
+        const uint8_t head[] = {precisions[i], 0, 0, 0, 0, 0};
+        ByteBuffer bad;
+        bad.concat(head, sizeof(head));
+        bad.setPos(0);
+        rejected = rejected && !bad.readHyperLogLog(small_decoded);
+    }
+    uint32_t entries[][2] = {{3 << 8 | 1, 2 << 8 | 1}, {1 << 8 | 0, 2 << 8 | 1},
+                             {1 << 8 | 52, 2 << 8 | 1}, {1 << 8 | 1, 16384u << 8 | 1}};
+    for (int i = 0; i < 4; i++) {
+        const uint8_t head[] = {14, 0};
+        ByteBuffer bad;
+        bad.concat(head, sizeof(head));
+        bad.writeUint(2);
+        bad.writeUint(entries[i][0]);
+        bad.writeUint(entries[i][1]);
+        bad.setPos(0);
+        rejected = rejected && !bad.readHyperLogLog(small_decoded);
+    }
+    const uint8_t dense_head[] = {18, 1, 0, 0};
+    ByteBuffer truncated;
+    truncated.concat(dense_head, sizeof(dense_head));
+    truncated.setPos(0);
+    rejected = rejected && !truncated.readHyperLogLog(small_decoded);
+    testAssert(rejected && small_decoded.isSparse() && small_decoded.estimate() == small.estimate(),
+               "HyperLogLog rejects invalid sketches");
+
+    big.clear();
+    testAssert(big.isSparse() && big.estimate() == 0, "Clear empties sketch");
+}
+
+void test_count_min() {
+    std::cout << "\n=== Testing CountMinSketch ===" << std::endl;
+
+    CountMinSketch sketch(4, 1000, 8);
+    std::map<ResourceId, uint32_t> exact;
+    unsigned int seed = 777;
+    for (int i = 0; i < 50000; i++) {
+        seed = seed * 1103515245 + 12345;
+        ResourceId rid = (seed >> 16) % 5000;
+        if (i % 5 == 0) {
+            rid = -(ResourceId) (i % 4) - 1;
+        }
+        sketch.add(rid);
+        exact[rid]++;
+    }
+    bool never_under = true;
+    uint64_t overshoot = 0;
+    for (std::map<ResourceId, uint32_t>::const_iterator itr = exact.begin(); itr != exact.end(); ++itr) {
+        uint32_t est = sketch.estimate(itr->first);
+        never_under = never_under && est >= itr->second;
+        overshoot += est - itr->second;
+    }
+    testAssert(never_under && sketch.totalCount() == 50000, "Count-min never underestimates");
+    testAssert(overshoot / exact.size() < 50000 * 2.72 / 1024, "Count-min error within bound");
+
+    CountMinSketch::Counts hitters = sketch.heavyHitters(1000);
+    bool hitters_ok = hitters.size() == 4;
+    for (size_t i = 0; i < hitters.size(); i++) {
+        hitters_ok = hitters_ok && hitters[i].first < 0 && hitters[i].second >= exact[hitters[i].first] &&
+                     (i == 0 || hitters[i - 1].second >= hitters[i].second);
+    }
+    testAssert(hitters_ok, "Count-min heavy hitters");
+
+    CountMinSketch other(4, 1000, 8);
+    other.add(4242, 20000);
+    testAssert(sketch.merge(other) && sketch.estimate(4242) >= 20000 && sketch.totalCount() == 70000,
+               "Count-min merge");
+    testAssert(sketch.heavyHitters().front().first == 4242, "Merged heavy hitters");
+    testAssert(!sketch.merge(CountMinSketch(2, 1000)), "Count-min merge rejects different sizes");
+
+    ByteBuffer buffer;
+    buffer.writeCountMin(sketch);
+    CountMinSketch decoded(1, 1);
+    buffer.setPos(0);
+    testAssert(buffer.readCountMin(decoded), "Count-min reads valid sketch");
+    bool same = decoded.totalCount() == sketch.totalCount() && decoded.heavyHitters() == sketch.heavyHitters();
+    for (ResourceId rid = -10; rid < 5000 && same; rid++) {
+        same = decoded.estimate(rid) == sketch.estimate(rid);
+    }
+    testAssert(same && buffer.getPos() == buffer.size(), "Count-min roundtrip");
+
+    bool rejected = true;
+    unsigned int dims[][2] = {{0, 1024}, {9, 1024}, {4, 0}, {4, 1000}};
+    for (int i = 0; i < 4; i++) {
+        ByteBuffer bad;
+        bad.writeUint(dims[i][0]);
+        bad.writeUint(dims[i][1]);
+        bad.writeUint(0);
+        bad.writeU64(0);
+        bad.writeUint(0);
+        bad.setPos(0);
+        rejected = rejected && !bad.readCountMin(decoded);
+    }
+    testAssert(rejected && decoded.totalCount() == sketch.totalCount(), "Count-min rejects invalid dimensions");
+
+    // Three candidates for a sketch keeping two, then counters past the buffer end
+    ByteBuffer bad;
+    bad.writeUint(1);
+    bad.writeUint(1);
+    bad.writeUint(2);
+    bad.writeU64(3);
+    bad.writeUint(3);
+    bad.writeUint(3);
+    for (int i = 0; i < 3; i++) {
+        bad.writeInt(i);
+    }
+    bad.setPos(0);
+    rejected = !bad.readCountMin(decoded);
+    bad.clear();
+    bad.writeUint(8);
+    bad.writeUint(1u << 30);
+    bad.writeUint(16);
+    bad.writeU64(0);
+    bad.setPos(0);
+    rejected = rejected && !bad.readCountMin(decoded);
+    testAssert(rejected && decoded.totalCount() == sketch.totalCount() &&
+               decoded.heavyHitters() == sketch.heavyHitters(), "Count-min rejects oversized contents");
+
+    CountMinSketch saturated(1, 1);
+    saturated.add(1, UINT32_MAX - 1);
+    testAssert(saturated.add(2, 5) == UINT32_MAX, "Count-min counters saturate");
+    saturated.clear();
+    testAssert(saturated.estimate(1) == 0 && saturated.heavyHitters().empty(), "Count-min clear");
+}
+
 void test_bitmap() {
     std::cout << "\n=== Testing Bitmap ===" << std::endl;
 
@@ -228,6 +1606,219 @@ void test_bitmap() {
     testAssert(bitmap.isEmpty(), "Bitmap empty after clear");
 }
 
+void test_bit_matrix() {
+    std::cout << "\n=== Testing BitMatrix ===" << std::endl;
+
+    uint64_t block[64], naive[64];
+    unsigned int seed = 31337;
+    for (int i = 0; i < 64; i++) {
+        seed = seed * 1103515245 + 12345;
+        block[i] = ((uint64_t) seed << 32) ^ (seed * 2654435761u);
+    }
+    for (int i = 0; i < 64; i++) {
+        naive[i] = 0;
+        for (int j = 0; j < 64; j++) {
+            naive[i] |= ((block[j] >> i) & 1) << j;
+        }
+    }
+    transpose64(block);
+    testAssert(std::equal(block, block + 64, naive), "transpose64 matches naive transpose");
+
+    BitMatrix matrix(8);
+    std::vector<Bitmap> rows;
+    for (ResourceId rid = 0; rid < 1000; rid++) {
+        Bitmap flags(8);
+        if (rid % 3 == 0) flags.set(3);
+        if (rid % 5 == 0) flags.set(5);
+        if (rid % 7 == 0) flags.set(0);
+        rows.push_back(flags);
+    }
+    matrix.setRows(0, rows);
+    testAssert(matrix.isSet(9, 3) && !matrix.isSet(9, 5) && matrix.row(35).getFlags() == 0x21 &&
+               matrix.rowCount() >= 1000, "BitMatrix setRows");
+
+    FlatResourceSet ids;
+    matrix.select(1 << 3, 1 << 5, ids);
+    bool select_ok = true;
+    size_t expected = 0;
+    for (ResourceId rid = 0; rid < (ResourceId) matrix.rowCount(); rid++) {
+        expected += (rid < 1000 && rid % 3 == 0 && rid % 5 != 0) ? 1 : 0;
+    }
+    for (size_t i = 0; i < ids.size(); i++) {
+        select_ok = select_ok && ids[i] % 3 == 0 && ids[i] % 5 != 0 && (i == 0 || ids[i - 1] < ids[i]);
+    }
+    testAssert(select_ok && ids.size() == expected && matrix.count(1 << 3, 1 << 5) == expected,
+               "BitMatrix selects bit 3 AND NOT bit 5");
+    matrix.select((1 << 3) | 1, 0, ids);
+    testAssert(ids.size() == 48 && ids[1] == 21, "BitMatrix selects multiple required flags");
+    testAssert(matrix.count(1 << 3, 1 << 3) == 0 && matrix.count(1 << 9, 0) == 0,
+               "BitMatrix contradictory or unknown flags match nothing");
+
+    matrix.set(5000, 7);
+    matrix.unset(9, 3);
+    Bitmap fresh(8);
+    fresh.set(1);
+    matrix.setRow(21, fresh);
+    testAssert(matrix.isSet(5000, 7) && !matrix.isSet(9, 3) && matrix.row(21).getFlags() == 2 &&
+               !matrix.isSet(100000, 1) && matrix.row(100000).isEmpty(), "BitMatrix single flag updates");
+
+    std::vector<Bitmap> partial;
+    matrix.getRows(60, 10, partial);
+    bool rows_ok = partial.size() == 10;
+    for (size_t i = 0; i < partial.size(); i++) {
+        rows_ok = rows_ok && partial[i].getFlags() == rows[60 + i].getFlags();
+    }
+    testAssert(rows_ok, "BitMatrix getRows across blocks");
+    std::vector<Bitmap> patch(3, fresh);
+    matrix.setRows(62, patch);
+    testAssert(matrix.row(61).getFlags() == rows[61].getFlags() && matrix.row(62).getFlags() == 2 &&
+               matrix.row(64).getFlags() == 2 && matrix.row(65).getFlags() == rows[65].getFlags(),
+               "BitMatrix setRows keeps neighbouring rows");
+    testAssert(matrix.column(7).size() * 64 >= matrix.rowCount() && matrix.rowCount() == 5001,
+               "BitMatrix column words");
+    matrix.clear();
+    testAssert(matrix.rowCount() == 0 && matrix.count(0, 0) == 0, "BitMatrix clear");
+
+    BitMatrix sparse(8);
+    sparse.set(3, 1);
+    sparse.set(128, 2);
+    sparse.select(0, 1 << 5, ids);
+    testAssert(sparse.rowCount() == 129 && ids.size() == 129 && ids.back() == 128 &&
+               sparse.count(0, 0) == 129 && sparse.count(0, 1 << 1) == 128,
+               "BitMatrix forbidden-only predicates stop at the last row set");
+}
+
+void test_delta_codec() {
+    std::cout << "\n=== Testing DeltaEncoder/DeltaDecoder ===" << std::endl;
+
+    DeltaEncoder encoder;
+    DeltaDecoder decoder;
+    ByteBuffer wire, value;
+
+    ResourceSet big;
+    for (int i = 0; i < 1000; i++) {
+        big.insert(i);
+    }
+    value.writeString("host-a");
+    encoder.setField(0, value);
+    value.clear();
+    value.writeUint(1);
+    encoder.setField(5, value);
+    encoder.setRset(2, big);
+    encoder.encode(wire);
+    unsigned int keyframe_size = wire.size();
+
+    wire.setPos(0);
+    decoder.apply(wire);
+    testAssert(decoder.rset(2) == big, "DeltaDecoder keyframe set");
+    std::string str;
+    ByteView field = decoder.field(0);
+    field.readString(str);
+    testAssert(str == "host-a", "DeltaDecoder keyframe field");
+
+    // Second tick: one field and two ids change
+    wire.clear();
+    value.clear();
+    value.writeUint(2);
+    encoder.setField(5, value);
+    value.clear();
+    value.writeString("host-a");
+    encoder.setField(0, value);
+    encoder.erase(2, 10);
+    encoder.insert(2, 5000);
+    encoder.encode(wire);
+    testAssert(wire.size() < keyframe_size / 50, "Delta is proportional to changes");
+
+    wire.setPos(0);
+    decoder.apply(wire);
+    big.erase(10);
+    big.insert(5000);
+    testAssert(decoder.rset(2) == big, "DeltaDecoder applies set changes");
+    testAssert(decoder.getChangedFields().getFlags() == (1ULL << 5), "DeltaDecoder reports changed fields");
+    unsigned int tick;
+    field = decoder.field(5);
+    field.readUint(tick);
+    testAssert(tick == 2, "DeltaDecoder applies field change");
+
+    // Unchanged tick and cancelled changes send only the header
+    wire.clear();
+    encoder.insert(2, 7000);
+    encoder.erase(2, 7000);
+    encoder.encode(wire);
+    testAssert(wire.size() == 17, "Delta without changes is header only");
+
+    // Resynchronization with a fresh decoder
+    wire.clear();
+    encoder.reset();
+    encoder.encode(wire);
+    DeltaDecoder fresh;
+    wire.setPos(0);
+    fresh.apply(wire);
+    testAssert(fresh.rset(2) == big && fresh.field(5).size() == 4, "DeltaEncoder reset sends keyframe");
+}
+
+void test_time_series() {
+    std::cout << "\n=== Testing TimeSeriesEncoder/TimeSeriesDecoder ===" << std::endl;
+
+    std::vector<int64_t> times;
+    std::vector<double> values;
+    int64_t t = 1700000000000LL;
+    double v = 21.5;
+    for (int i = 0; i < 1000; i++) {
+        t += (i % 100 == 99 ? 10007 : 10000);
+        if (i % 10 == 0) {
+            v += 0.25;
+        }
+        times.push_back(t);
+        values.push_back(v);
+    }
+    times.push_back(t - 5000000000LL);
+    values.push_back(-1e300);
+    times.push_back(t);
+    values.push_back(0.0);
+
+    TimeSeriesEncoder encoder;
+    for (size_t i = 0; i < times.size(); i++) {
+        encoder.append(times[i], values[i]);
+    }
+    ByteBuffer buffer;
+    encoder.write(buffer);
+    buffer.writeUint(0xBEEF);
+    testAssert(encoder.size() == times.size(), "TimeSeriesEncoder point count");
+    testAssert(buffer.size() * 10 < times.size() * 16, "TimeSeriesEncoder compresses 10x");
+
+    buffer.setPos(0);
+    TimeSeriesDecoder decoder(buffer);
+    bool ok = decoder.size() == times.size();
+    int64_t read_time;
+    double read_val;
+    for (size_t i = 0; i < times.size(); i++) {
+        ok = ok && decoder.next(read_time, read_val) && read_time == times[i] && read_val == values[i];
+    }
+    testAssert(ok, "TimeSeriesDecoder roundtrip");
+    testAssert(!decoder.next(read_time, read_val), "TimeSeriesDecoder stops at end");
+    unsigned int marker;
+    buffer.readUint(marker);
+    testAssert(marker == 0xBEEF, "TimeSeriesDecoder consumes series");
+
+    TimeSeriesEncoder walk, gauge;
+    float walk_val = 20.0f;
+    double gauge_val = 100.0;
+    unsigned int seed = 5;
+    for (int i = 0; i < 10000; i++) {
+        seed = seed * 1103515245 + 12345;
+        walk_val += ((int) (seed >> 16) % 21 - 10) * 0.01f;
+        gauge_val += ((int) (seed >> 8) % 3 - 1) * 0.5;
+        walk.append(1000 + i * 10, walk_val);
+        gauge.append(1000 + i * 10, gauge_val);
+    }
+    ByteBuffer walk_buf, gauge_buf;
+    walk.write(walk_buf);
+    gauge.write(gauge_buf);
+    testAssert(walk_buf.size() * 8 < 10000 * 32, "TimeSeriesEncoder random walk below 32 bits per value");
+    testAssert(gauge_buf.size() * 8 < 10000 * 12, "TimeSeriesEncoder stepped gauge below 12 bits per value");
+}
+
 void test_iterator() {
     std::cout << "\n=== Testing Iterator ===" << std::endl;
 
@@ -403,7 +1994,34 @@ int main(void) {
     // Run all test suites
     test_endian_functions();
     test_byte_buffer();
+    test_byte_buffer_skip();
+    test_byte_view();
+    test_table_layout();
+    test_varint();
+    test_tagged_fields();
+    test_shared_buffer();
+    test_string_table();
+    test_sorted_strings();
+    test_utf8_string();
+    test_packed_ints();
+    test_elias_fano();
+    test_bit_stream();
+    test_float_arrays();
+    test_text_transcoding();
+    test_hash();
+    test_encode_cache();
+    test_resource_set_pool();
+    test_persistent_resource_set();
+    test_epoch_reclamation();
+    test_sharded_map();
+    test_radix_sort();
+    test_bloom_filter();
+    test_hyperloglog();
+    test_count_min();
     test_bitmap();
+    test_bit_matrix();
+    test_delta_codec();
+    test_time_series();
     test_iterator();
     test_get_iterator_from_map();
     test_combination_generator();